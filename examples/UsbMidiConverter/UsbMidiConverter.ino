@@ -11,9 +11,13 @@
  */
 
 #include <usbmidi.h>
+#include <usbmidi_serial_bridge.h>
+
+//Forwards both ways as far as the other side has room, using running status on the serial side
+UsbMidiSerialBridge bridge(Serial1);
 
 void setup() {
-  Serial1.begin(31250); //MIDI baudrate
+  bridge.begin(); //MIDI baudrate
 }
 
 void loop() {
@@ -21,8 +25,5 @@ void loop() {
   USBMIDI.poll();
 
   //Forward MIDI
-  while(USBMIDI.available()) Serial1.write(USBMIDI.read());
-  Serial1.flush();
-  while(Serial1.available()) USBMIDI.write(Serial1.read());
-  USBMIDI.flush();
+  bridge.poll();
 }
@@ -1,5 +1,5 @@
 /*
- * Simple USBMIDI synth v0.2
+ * Simple USBMIDI synth v0.3
  *
  * Plays MIDI notes using square waves on SNDOUT pin
  * Attach piezo or audio amplifier to that pin and send some notes to it
@@ -36,28 +36,26 @@ void loop() {
   //Handle USB communication
   USBMIDI.poll();
 
-  // While there's MIDI USB input available...
-  while (USBMIDI.available()) {
+  // While there are MIDI USB events available...
+  midi_event_t ev;
+  while (USBMIDI.readEvent(ev)) {
 
-    //Parse MIDI
+    //Parse MIDI, each event carries one complete message
     u8 command=0, channel=0, key=0, pitchbend=0, pblo=0, pbhi=0, velocity=0;
 
-    //Skip to beginning of next message (silently dropping stray data bytes)
-    while(!(USBMIDI.peek() & 0b10000000)) USBMIDI.read();
-
-    command = USBMIDI.read();
+    command = ev.m_data[0];
     channel = (command & 0b00001111)+1;
     command = command & 0b11110000;
 
     switch(command) {
       case MIDI_NOTE_ON:
       case MIDI_NOTE_OFF:
-        if(USBMIDI.peek() & 0b10000000) continue; key      = USBMIDI.read();
-        if(USBMIDI.peek() & 0b10000000) continue; velocity = USBMIDI.read();
+        key      = ev.m_data[1];
+        velocity = ev.m_data[2];
         break;
       case MIDI_PITCH_BEND:
-        if(USBMIDI.peek() & 0b10000000) continue; pblo = USBMIDI.read();
-        if(USBMIDI.peek() & 0b10000000) continue; pbhi = USBMIDI.read();
+        pblo = ev.m_data[1];
+        pbhi = ev.m_data[2];
         int pitchbend = (pblo << 7) | pbhi;
         //TODO: apply pitchbend to tone
         break;
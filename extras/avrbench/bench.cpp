@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Cycle counting benchmark of the library's hot paths, run under simavr with 'make run'.
+//
+// Each operation is timed on its own with Timer1 running at the CPU clock, the cost of reading
+// the timer is calibrated and subtracted. Results are printed through simavr's console register
+// as min / avg / max cycles per call, max being the worst path taken over the whole input.
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include <stdio.h>
+
+#include <avr_mcu_section.h>
+
+#include "fifo.h"
+#include "midi_serialization.h"
+
+#ifndef USBCON
+#	include "usbdrv.h"
+#	include "usbmidi.h"
+#endif
+
+AVR_MCU(F_CPU, BENCH_MCU);
+AVR_MCU_SIMAVR_CONSOLE(&GPIOR0);
+
+struct stats_t
+{
+	uint16_t m_min;
+	uint16_t m_max;
+	uint32_t m_sum;
+	uint16_t m_count;
+};
+
+static uint16_t g_overhead;
+static volatile uint8_t g_sink;
+
+#define BARRIER() asm volatile("" ::: "memory")
+
+// Times a single evaluation of expr, in CPU cycles.
+#define MEASURE(stats, expr) \
+	do { \
+		BARRIER(); \
+		uint16_t t0 = TCNT1; \
+		BARRIER(); \
+		expr; \
+		BARRIER(); \
+		uint16_t t1 = TCNT1; \
+		BARRIER(); \
+		record(stats, t1 - t0 - g_overhead); \
+	} while (0)
+
+static void reset(stats_t &s)
+{
+	s.m_min = 0xffff;
+	s.m_max = 0;
+	s.m_sum = 0;
+	s.m_count = 0;
+}
+
+static void record(stats_t &s, uint16_t cycles)
+{
+	if (cycles < s.m_min)
+		s.m_min = cycles;
+	if (cycles > s.m_max)
+		s.m_max = cycles;
+	s.m_sum += cycles;
+	++s.m_count;
+}
+
+static void report(const char *op, const char *input, const stats_t &s)
+{
+	printf("%-26s %-22s %6u %6lu %6u\n", op, input, s.m_min, s.m_count ? s.m_sum / s.m_count : 0ul, s.m_max);
+}
+
+// Returns false if timing a delay of known length doesn't give the expected count, like when
+// Timer1 isn't counting at the CPU clock.
+static bool calibrate()
+{
+	stats_t s;
+	reset(s);
+	g_overhead = 0;
+	for (uint8_t i=0; i<16; ++i)
+		MEASURE(s, (void)0);
+	g_overhead = s.m_min;
+
+	reset(s);
+	for (uint8_t i=0; i<16; ++i)
+		MEASURE(s, __builtin_avr_delay_cycles(100));
+
+	printf("timer check: 100 cycle delay measured as %u - %u cycles\n", s.m_min, s.m_max);
+	return s.m_min >= 99 && s.m_max <= 101;
+}
+
+static int console_putc(char c, FILE *stream)
+{
+	(void)stream;
+	GPIOR0 = c;
+	return 0;
+}
+
+static FILE g_console;
+
+// Byte streams, generated on the fly to stay within the RAM of the smaller parts.
+typedef uint8_t (*generator_t)(uint16_t i);
+
+// Note on/off with the status byte sent once per 48 notes.
+static uint8_t running_status_notes(uint16_t i)
+{
+	uint8_t pos = i % 97;
+	if (pos == 0)
+		return 0x90 | ((i / 97) & 0x0f);
+	if (pos & 1)
+		return 36 + pos / 2;
+	return pos & 2 ? 0 : 100;
+}
+
+// SysEx messages of 256 bytes, with a MIDI clock after every 7 data bytes.
+static uint8_t sysex_with_clock(uint16_t i)
+{
+	uint16_t pos = i % 296;
+	if (pos == 0)
+		return 0xf0;
+	if (pos == 295)
+		return 0xf7;
+	if (pos % 8 == 1)
+		return 0xf8;
+	return pos & 0x7f;
+}
+
+// Control Changes with full status bytes.
+static uint8_t cc_flood(uint16_t i)
+{
+	switch (i % 3)
+	{
+	case 0: return 0xb0 | ((i / 3) & 0x0f);
+	case 1: return (i / 3) % 120;
+	default: return (i * 7) & 0x7f;
+	}
+}
+
+struct corpus_t
+{
+	const char *m_name;
+	generator_t m_generate;
+};
+
+static const corpus_t CORPORA[] =
+{
+	{ "running status notes", &running_status_notes },
+	{ "sysex with clock", &sysex_with_clock },
+	{ "cc flood", &cc_flood },
+};
+
+static const uint16_t CORPUS_BYTES = 3000;
+
+static void bench_serialization(const corpus_t &c)
+{
+	stats_t toUsb, toMidi;
+	reset(toUsb);
+	reset(toMidi);
+
+	MidiToUsb serializer(0);
+	midi_event_t ev;
+	uint8_t out[3];
+
+	for (uint16_t i=0; i<CORPUS_BYTES; ++i)
+	{
+		uint8_t byte = c.m_generate(i);
+		bool ready;
+		MEASURE(toUsb, ready = serializer.process(byte, ev));
+
+		if (ready)
+		{
+			uint8_t n;
+			MEASURE(toMidi, n = UsbToMidi::process(ev, out));
+			g_sink = out[n - 1];
+		}
+	}
+
+	report("MidiToUsb::process", c.m_name, toUsb);
+	report("UsbToMidi::process", c.m_name, toMidi);
+}
+
+// The output queue type of the V-USB backend, USBMIDI_VUSB_OUT_EVENTS is passed by the Makefile to
+// both, and the SPSC queue of the same capacity.
+static TFifo<midi_event_t, uint8_t, USBMIDI_VUSB_OUT_EVENTS + 1> g_fifo;
+static TSpscFifo<midi_event_t, uint8_t, USBMIDI_VUSB_OUT_EVENTS + 1> g_spscFifo;
+
+template <typename Fifo>
+static void bench_fifo(const char *pushName, const char *popName, Fifo &fifo)
+{
+	stats_t push, pop;
+	reset(push);
+	reset(pop);
+
+	midi_event_t ev = { 0x09, { 0x90, 60, 100 } };
+	for (uint16_t i=0; i<256; ++i)
+	{
+		// Fill up in varying amounts, to cover both the wrapping and non-wrapping paths.
+		uint8_t n = 1 + i % USBMIDI_VUSB_OUT_EVENTS;
+		for (uint8_t j=0; j<n; ++j)
+			MEASURE(push, fifo.push(ev));
+		for (uint8_t j=0; j<n; ++j)
+			MEASURE(pop, fifo.pop(ev));
+	}
+
+	report(pushName, "", push);
+	report(popName, "", pop);
+}
+
+#ifndef USBCON
+// Provided by the Arduino core otherwise, only used for suspend detection.
+unsigned long millis()
+{
+	return 0;
+}
+
+extern "C" void __cxa_pure_virtual()
+{
+	for (;;);
+}
+
+void operator delete(void *p)
+{
+	(void)p;
+}
+
+void operator delete(void *p, size_t size)
+{
+	(void)p;
+	(void)size;
+}
+
+// Marks the interrupt IN endpoint free, as if the host took the previous packet.
+static void hostTookPacket()
+{
+	usbTxLen1 = USBPID_NAK;
+}
+
+// The V-USB backend, through the USBMIDI object: writeEvent() queueing output, poll() handing up
+// to 2 events to the interrupt IN endpoint (usbPoll() included, with no USB traffic pending),
+// and the receive path from an 8 byte OUT packet to readEvent().
+static void bench_vusb()
+{
+	stats_t write, writeRealTime, idle, one, two, realTime, receive, read;
+	reset(write);
+	reset(writeRealTime);
+	reset(idle);
+	reset(one);
+	reset(two);
+	reset(realTime);
+	reset(receive);
+	reset(read);
+
+	const midi_event_t note = { 0x09, { 0x90, 60, 100 } };
+	const midi_event_t clock = { 0x0f, { 0xf8, 0, 0 } };
+
+	for (uint16_t i=0; i<128; ++i)
+	{
+		hostTookPacket();
+		MEASURE(idle, USBMIDI.poll());
+
+		uint8_t count = 1 + (i & 1);
+		for (uint8_t j=0; j<count; ++j)
+			MEASURE(write, USBMIDI.writeEvent(note));
+
+		hostTookPacket();
+		MEASURE(count == 1 ? one : two, USBMIDI.poll());
+	}
+
+	// A clock overtaking 2 queued notes through the Real-Time lane.
+	for (uint16_t i=0; i<64; ++i)
+	{
+		USBMIDI.writeEvent(note);
+		USBMIDI.writeEvent(note);
+		MEASURE(writeRealTime, USBMIDI.writeEvent(clock));
+
+		hostTookPacket();
+		MEASURE(realTime, USBMIDI.poll());
+		hostTookPacket();
+		USBMIDI.poll();
+	}
+
+	uint8_t packet[8] = { 0x09, 0x90, 60, 100, 0x08, 0x80, 60, 0 };
+	midi_event_t ev;
+	for (uint16_t i=0; i<128; ++i)
+	{
+		MEASURE(receive, usbFunctionWriteOut(packet, sizeof(packet)));
+		MEASURE(read, g_sink = USBMIDI.readEvent(ev));
+		MEASURE(read, g_sink = USBMIDI.readEvent(ev));
+	}
+
+	report("USBMIDI.writeEvent", "note", write);
+	report("USBMIDI.writeEvent", "clock, 2 notes queued", writeRealTime);
+	report("USBMIDI.poll", "nothing queued", idle);
+	report("USBMIDI.poll", "1 event", one);
+	report("USBMIDI.poll", "2 events", two);
+	report("USBMIDI.poll", "clock, 2 notes queued", realTime);
+	report("usbFunctionWriteOut", "2 events", receive);
+	report("USBMIDI.readEvent", "", read);
+}
+#endif
+
+static void run()
+{
+	printf("USBMIDI cycle counts on %s, timer overhead %u cycles subtracted\n", BENCH_MCU, g_overhead);
+	printf("%-26s %-22s %6s %6s %6s\n", "operation", "input", "min", "avg", "max");
+
+	for (uint8_t i=0; i<sizeof(CORPORA)/sizeof(CORPORA[0]); ++i)
+		bench_serialization(CORPORA[i]);
+
+	bench_fifo("TFifo::push", "TFifo::pop", g_fifo);
+	bench_fifo("TSpscFifo::push", "TSpscFifo::pop", g_spscFifo);
+
+#ifndef USBCON
+	// The USBMIDI constructor has already initialized V-USB, interrupts stay disabled as there's
+	// no USB traffic to serve.
+	bench_vusb();
+#endif
+}
+
+int main()
+{
+	fdev_setup_stream(&g_console, console_putc, NULL, _FDEV_SETUP_WRITE);
+	stdout = &g_console;
+
+	// Timer1 counting CPU cycles.
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);
+
+	if (calibrate())
+		run();
+	else printf("Timer1 calibration failed, no results\n");
+
+	// simavr exits once the CPU sleeps with interrupts disabled.
+	cli();
+	sleep_cpu();
+	return 0;
+}
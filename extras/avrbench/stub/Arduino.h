@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Stand-in for the Arduino core on AVR, enough to link the V-USB backend without it.
+// millis() is provided by bench.cpp.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "Stream.h"
+
+typedef uint8_t u8;
+
+unsigned long millis();
+
+#endif // Arduino_h
@@ -0,0 +1,12 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// The host simulation's Print and Stream don't depend on the host, shared from there, as
+// its stub directory can't be added to the include path due to its own avr/io.h.
+
+#include "../../hostsim/stub/Stream.h"
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Host microbenchmark for MidiToUsb and UsbToMidi. Build and run with 'make run'.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "midi_serialization.h"
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<midi_event_t> Events;
+
+// Each benchmark is repeated until at least this much time has passed.
+static const double MIN_DURATION_NS = 200e6;
+
+static volatile unsigned g_sink;
+
+static double now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Dense note on/off stream, status byte sent once per 32 notes.
+static Bytes make_running_status_notes()
+{
+	Bytes b;
+	for (unsigned i=0; i<1024; ++i)
+	{
+		if (i % 32 == 0)
+			b.push_back(0x90 | (i / 32 & 0x0f));
+		b.push_back(36 + i % 48);
+		b.push_back(i & 1 ? 0 : 100);
+	}
+	return b;
+}
+
+// SysEx messages with MIDI clock interleaved every 7 data bytes.
+static Bytes make_sysex_with_clock()
+{
+	Bytes b;
+	for (unsigned m=0; m<16; ++m)
+	{
+		b.push_back(0xf0);
+		for (unsigned i=0; i<256; ++i)
+		{
+			if (i % 7 == 0)
+				b.push_back(0xf8);
+			b.push_back(i & 0x7f);
+		}
+		b.push_back(0xf7);
+	}
+	return b;
+}
+
+// Patch librarian style dumps.
+static Bytes make_large_sysex()
+{
+	Bytes b;
+	for (unsigned m=0; m<4; ++m)
+	{
+		b.push_back(0xf0);
+		b.push_back(0x7d);
+		for (unsigned i=0; i<4096; ++i)
+			b.push_back((i * 13 + m) & 0x7f);
+		b.push_back(0xf7);
+	}
+	return b;
+}
+
+// Control Changes from many knobs, full status byte on every message.
+static Bytes make_cc_flood()
+{
+	Bytes b;
+	for (unsigned i=0; i<2048; ++i)
+	{
+		b.push_back(0xb0 | (i & 0x0f));
+		b.push_back(i % 120);
+		b.push_back((i * 7) & 0x7f);
+	}
+	return b;
+}
+
+static Events to_events(const Bytes &bytes)
+{
+	Events events;
+	MidiToUsb serializer(0);
+	midi_event_t ev;
+	for (size_t i=0; i<bytes.size(); ++i)
+	{
+		if (serializer.process(bytes[i], ev))
+			events.push_back(ev);
+	}
+	return events;
+}
+
+static void bench_midi_to_usb(const char *name, const Bytes &bytes)
+{
+	MidiToUsb serializer(0);
+	midi_event_t ev;
+	unsigned long long events = 0;
+	unsigned long long processed = 0;
+	double start = now_ns();
+	double elapsed;
+	do
+	{
+		for (size_t i=0; i<bytes.size(); ++i)
+		{
+			if (serializer.process(bytes[i], ev))
+			{
+				g_sink = ev.m_data[0];
+				++events;
+			}
+		}
+		processed += bytes.size();
+		elapsed = now_ns() - start;
+	} while (elapsed < MIN_DURATION_NS);
+
+	printf("%-24s %-28s %8.2f ns/byte %10.2f Mevents/s\n", "MidiToUsb::process", name,
+		elapsed / processed, events / elapsed * 1e3);
+}
+
+static void bench_midi_to_usb_buffer(const char *name, const Bytes &bytes)
+{
+	MidiToUsb serializer(0);
+	midi_event_t ev[16];
+	unsigned long long events = 0;
+	unsigned long long processed = 0;
+	double start = now_ns();
+	double elapsed;
+	do
+	{
+		const uint8_t *p = &bytes[0];
+		size_t remaining = bytes.size();
+		while (remaining)
+		{
+			size_t consumed;
+			size_t n = serializer.processBuffer(p, remaining, ev, 16, consumed);
+			g_sink = ev[0].m_data[0];
+			events += n;
+			p += consumed;
+			remaining -= consumed;
+		}
+		processed += bytes.size();
+		elapsed = now_ns() - start;
+	} while (elapsed < MIN_DURATION_NS);
+
+	printf("%-24s %-28s %8.2f ns/byte %10.2f Mevents/s\n", "MidiToUsb::processBuffer", name,
+		elapsed / processed, events / elapsed * 1e3);
+}
+
+static void bench_usb_to_midi(const char *name, const Events &events)
+{
+	uint8_t out[3];
+	unsigned long long bytes = 0;
+	unsigned long long processed = 0;
+	double start = now_ns();
+	double elapsed;
+	do
+	{
+		for (size_t i=0; i<events.size(); ++i)
+		{
+			unsigned n = UsbToMidi::process(events[i], out);
+			g_sink = out[0];
+			bytes += n;
+		}
+		processed += events.size();
+		elapsed = now_ns() - start;
+	} while (elapsed < MIN_DURATION_NS);
+
+	printf("%-24s %-28s %8.2f ns/byte %10.2f Mevents/s\n", "UsbToMidi::process", name,
+		elapsed / bytes, processed / elapsed * 1e3);
+}
+
+// Decodes every event of a packet to MIDI bytes, as reading a port does.
+struct packet_decoder_t
+{
+	unsigned long long m_bytes;
+
+	void operator()(const midi_event_t &ev)
+	{
+		uint8_t out[3];
+		m_bytes += UsbToMidi::process(ev, out);
+		g_sink = out[0];
+	}
+};
+
+static void bench_usb_to_midi_packet(const char *name, const Events &events)
+{
+	// Split 64 byte bulk packets, as received on full speed USB.
+	const uint8_t *raw = (const uint8_t *)&events[0];
+	size_t size = events.size() * sizeof(midi_event_t);
+	packet_decoder_t decoder = { 0 };
+	unsigned long long processed = 0;
+	double start = now_ns();
+	double elapsed;
+	do
+	{
+		for (size_t i=0; i<size; i += 64)
+			UsbToMidi::processPacket(raw + i, size - i < 64 ? size - i : 64, decoder);
+		processed += events.size();
+		elapsed = now_ns() - start;
+	} while (elapsed < MIN_DURATION_NS);
+
+	printf("%-24s %-28s %8.2f ns/byte %10.2f Mevents/s\n", "UsbToMidi::processPacket", name,
+		elapsed / decoder.m_bytes, processed / elapsed * 1e3);
+}
+
+struct corpus_t
+{
+	const char *m_name;
+	Bytes (*m_make)();
+};
+
+static const corpus_t CORPORA[] =
+{
+	{ "running status notes", &make_running_status_notes },
+	{ "sysex with clock", &make_sysex_with_clock },
+	{ "large sysex", &make_large_sysex },
+	{ "cc flood", &make_cc_flood },
+};
+
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+
+	for (unsigned i=0; i<sizeof(CORPORA)/sizeof(CORPORA[0]); ++i)
+	{
+		const corpus_t &c = CORPORA[i];
+		if (filter && !strstr(c.m_name, filter))
+			continue;
+
+		Bytes bytes = c.m_make();
+		Events events = to_events(bytes);
+
+		bench_midi_to_usb(c.m_name, bytes);
+		bench_midi_to_usb_buffer(c.m_name, bytes);
+		bench_usb_to_midi(c.m_name, events);
+		bench_usb_to_midi_packet(c.m_name, events);
+	}
+
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Host check that MidiToUsb::processBuffer produces exactly the same events as MidiToUsb::process
+// fed byte by byte, for random and SysEx heavy streams split into random chunks with random
+// output capacities. Build and run with 'make check'.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "midi_serialization.h"
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<midi_event_t> Events;
+
+static unsigned g_seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	g_seed = g_seed * 1103515245 + 12345;
+	return (g_seed >> 16) % n;
+}
+
+static uint8_t data_byte()
+{
+	return rnd(0x80);
+}
+
+static uint8_t real_time_byte()
+{
+	static const uint8_t BYTES[] = { 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+	return BYTES[rnd(sizeof(BYTES))];
+}
+
+// Any byte value at all, including undefined status bytes and stray data bytes.
+static Bytes make_random(unsigned size)
+{
+	Bytes b;
+	for (unsigned i=0; i<size; ++i)
+		b.push_back(rnd(4) == 0 ? 0x80 | rnd(0x80) : data_byte());
+	return b;
+}
+
+// SysEx messages of random lengths with Real-Time messages interleaved, some cut short by
+// another status byte, separated by Channel and System Common messages.
+static Bytes make_sysex_heavy(unsigned count)
+{
+	Bytes b;
+	for (unsigned m=0; m<count; ++m)
+	{
+		b.push_back(0xf0);
+		unsigned length = rnd(64);
+		for (unsigned i=0; i<length; ++i)
+		{
+			if (rnd(8) == 0)
+				b.push_back(real_time_byte());
+			b.push_back(data_byte());
+		}
+
+		switch (rnd(4))
+		{
+		case 0:
+			// Aborted by a Channel message.
+			b.push_back(0x90 | rnd(16));
+			b.push_back(data_byte());
+			b.push_back(data_byte());
+			break;
+		case 1:
+			// Aborted by a System Common message.
+			b.push_back(0xf2);
+			b.push_back(data_byte());
+			b.push_back(data_byte());
+			break;
+		default:
+			b.push_back(0xf7);
+			break;
+		}
+
+		if (rnd(2))
+		{
+			b.push_back(0xb0 | rnd(16));
+			b.push_back(data_byte());
+			b.push_back(data_byte());
+			b.push_back(data_byte());
+		}
+	}
+	return b;
+}
+
+static Events serialize_bytes(int cable, const Bytes &bytes)
+{
+	Events events;
+	MidiToUsb serializer(cable);
+	midi_event_t ev;
+	for (size_t i=0; i<bytes.size(); ++i)
+	{
+		if (serializer.process(bytes[i], ev))
+			events.push_back(ev);
+	}
+	return events;
+}
+
+static Events serialize_buffer(int cable, const Bytes &bytes, unsigned max_chunk, unsigned max_cap)
+{
+	Events events;
+	MidiToUsb serializer(cable);
+	midi_event_t out[64];
+	size_t i = 0;
+	while (i < bytes.size())
+	{
+		size_t chunk = 1 + rnd(max_chunk);
+		if (chunk > bytes.size() - i)
+			chunk = bytes.size() - i;
+
+		// Keep feeding the chunk until it's used up, as the callers of processBuffer do.
+		size_t end = i + chunk;
+		while (i < end)
+		{
+			size_t cap = 1 + rnd(max_cap);
+			size_t consumed;
+			size_t count = serializer.processBuffer(&bytes[i], end - i, out, cap, consumed);
+			if (count > cap || consumed > end - i || (count < cap && consumed != end - i))
+			{
+				fprintf(stderr, "processBuffer returned %u events for %u bytes, cap %u, %u bytes given\n",
+					(unsigned)count, (unsigned)consumed, (unsigned)cap, (unsigned)(end - i));
+				exit(1);
+			}
+			events.insert(events.end(), out, out + count);
+			i += consumed;
+		}
+	}
+	return events;
+}
+
+static bool check(const char *name, int cable, const Bytes &bytes, unsigned max_chunk, unsigned max_cap)
+{
+	Events expected = serialize_bytes(cable, bytes);
+	Events actual = serialize_buffer(cable, bytes, max_chunk, max_cap);
+
+	size_t n = expected.size() < actual.size() ? expected.size() : actual.size();
+	for (size_t i=0; i<n; ++i)
+	{
+		if (memcmp(&expected[i], &actual[i], sizeof(midi_event_t)) != 0)
+		{
+			const uint8_t *e = (const uint8_t *)&expected[i];
+			const uint8_t *a = (const uint8_t *)&actual[i];
+			printf("FAIL %s, chunk %u, cap %u: event %u is %02x %02x %02x %02x, expected %02x %02x %02x %02x\n",
+				name, max_chunk, max_cap, (unsigned)i, a[0], a[1], a[2], a[3], e[0], e[1], e[2], e[3]);
+			return false;
+		}
+	}
+
+	if (expected.size() != actual.size())
+	{
+		printf("FAIL %s, chunk %u, cap %u: %u events, expected %u\n", name, max_chunk, max_cap,
+			(unsigned)actual.size(), (unsigned)expected.size());
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned CHUNKS[] = { 1, 2, 3, 4, 7, 64, 1024 };
+	static const unsigned CAPS[] = { 1, 2, 3, 16, 64 };
+
+	unsigned runs = 0;
+	unsigned failures = 0;
+	for (unsigned round=0; round<20; ++round)
+	{
+		int cable = round % 16;
+		Bytes random = make_random(4096);
+		Bytes sysex = make_sysex_heavy(64);
+
+		for (unsigned c=0; c<sizeof(CHUNKS)/sizeof(CHUNKS[0]); ++c)
+		{
+			for (unsigned k=0; k<sizeof(CAPS)/sizeof(CAPS[0]); ++k)
+			{
+				failures += !check("random", cable, random, CHUNKS[c], CAPS[k]);
+				failures += !check("sysex heavy", cable, sysex, CHUNKS[c], CAPS[k]);
+				runs += 2;
+			}
+		}
+	}
+
+	printf("%u of %u runs matched\n", runs - failures, runs);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Runs the USBMIDI library against a simulated host, see sim_pluggableusb.cpp and
+// sim_vusb.cpp for the transports. Usage:
+//
+//   hostsim_<transport> [--scenario=out|in|echo] [--events=N] [--loop-us=N] [--read-batch=N]
+//                       [--host-rate=N] [--poll-cost-us=N] [--clock-every=N]
+//
+// out  - the sketch writes note messages as fast as it can, the host reads them.
+// in   - the host sends note events, at --host-rate events/s or as fast as the device takes them,
+//        the sketch reads up to --read-batch events per cable per loop (0 - all of them).
+// echo - the host sends, the sketch writes back every event it reads.
+//
+// With --clock-every, every Nth event the host sends is a MIDI clock instead of a note, to put
+// load on the Real-Time input lane.
+//
+// Every loop() iteration costs --loop-us simulated microseconds. Events carry a sequence number
+// per cable, which is checked on arrival to detect lost or reordered events, dropped events show
+// up as sequence errors too. Exits with 2 if the run doesn't complete in simulated 10 minutes.
+
+#include "sim.h"
+
+#include <usbmidi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum scenario_e
+{
+	SCENARIO_OUT,
+	SCENARIO_IN,
+	SCENARIO_ECHO,
+};
+
+static scenario_e g_scenario = SCENARIO_OUT;
+static uint32_t g_eventCount = 10000;
+static uint32_t g_loopUs = 20;
+static uint32_t g_readBatch = 0;
+static uint32_t g_hostRate = 0;
+static uint32_t g_clockEvery = 0;
+
+// Give up if the simulated run takes longer than this.
+static const uint64_t TIMEOUT_US = 600000000ull;
+
+static uint32_t g_hostSent;
+static uint16_t g_hostSeq[USBMIDI_CABLE_COUNT];
+static uint16_t g_hostExpected[USBMIDI_CABLE_COUNT];
+static uint32_t g_hostReceived;
+
+static uint32_t g_sketchRead;
+static uint16_t g_sketchExpected[USBMIDI_CABLE_COUNT];
+
+static uint32_t g_sequenceErrors;
+
+static midi_event_t makeNote(uint8_t cable, uint16_t seq)
+{
+	midi_event_t ev;
+	ev.m_event = (cable << 4) | 0x9;
+	ev.m_data[0] = 0x90;
+	ev.m_data[1] = seq & 0x7f;
+	ev.m_data[2] = (seq >> 7) & 0x7f;
+	return ev;
+}
+
+static bool isClock(const midi_event_t &ev)
+{
+	return (ev.m_event & 0x0f) == 0xf && ev.m_data[0] == 0xf8;
+}
+
+static uint16_t noteSeq(const midi_event_t &ev)
+{
+	return ev.m_data[1] | (ev.m_data[2] << 7);
+}
+
+static void checkSeq(uint16_t &expected, const midi_event_t &ev)
+{
+	if (noteSeq(ev) != (expected & 0x3fff))
+		++g_sequenceErrors;
+
+	expected = noteSeq(ev) + 1;
+}
+
+bool sim_host_has_out()
+{
+	if (g_scenario == SCENARIO_OUT || g_hostSent == g_eventCount)
+		return false;
+
+	return g_hostRate == 0 || g_hostSent < sim_now_us() * g_hostRate / 1000000;
+}
+
+bool sim_host_next_out(midi_event_t &ev)
+{
+	if (!sim_host_has_out())
+		return false;
+
+	uint8_t cable = g_hostSent % USBMIDI_CABLE_COUNT;
+	if (g_clockEvery != 0 && g_hostSent % g_clockEvery == g_clockEvery - 1)
+	{
+		ev.m_event = (cable << 4) | 0xf;
+		ev.m_data[0] = 0xf8;
+		ev.m_data[1] = 0;
+		ev.m_data[2] = 0;
+	}
+	else ev = makeNote(cable, g_hostSeq[cable]++);
+	++g_hostSent;
+	return true;
+}
+
+void sim_host_received(const midi_event_t &ev)
+{
+	uint8_t cable = ev.m_event >> 4;
+	if (cable >= USBMIDI_CABLE_COUNT)
+	{
+		++g_sequenceErrors;
+		return;
+	}
+
+	if (!isClock(ev))
+		checkSeq(g_hostExpected[cable], ev);
+	++g_hostReceived;
+}
+
+static bool parseOption(const char *arg, const char *name, uint32_t &value)
+{
+	size_t n = strlen(name);
+	if (strncmp(arg, name, n) != 0 || arg[n] != '=')
+		return false;
+
+	value = strtoul(arg + n + 1, NULL, 0);
+	return true;
+}
+
+static bool parseArgs(int argc, char **argv)
+{
+	for (int i=1; i<argc; ++i)
+	{
+		const char *arg = argv[i];
+		if (strcmp(arg, "--scenario=out") == 0)
+			g_scenario = SCENARIO_OUT;
+		else if (strcmp(arg, "--scenario=in") == 0)
+			g_scenario = SCENARIO_IN;
+		else if (strcmp(arg, "--scenario=echo") == 0)
+			g_scenario = SCENARIO_ECHO;
+		else if (!parseOption(arg, "--events", g_eventCount) &&
+			!parseOption(arg, "--loop-us", g_loopUs) &&
+			!parseOption(arg, "--read-batch", g_readBatch) &&
+			!parseOption(arg, "--host-rate", g_hostRate) &&
+			!parseOption(arg, "--poll-cost-us", g_simPollCostUs) &&
+			!parseOption(arg, "--clock-every", g_clockEvery))
+		{
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool done()
+{
+	switch (g_scenario)
+	{
+	case SCENARIO_OUT:
+	case SCENARIO_ECHO:
+		return g_hostReceived + USBMIDI.getOverflowCount() >= g_eventCount;
+	case SCENARIO_IN:
+		return g_sketchRead + USBMIDI.getOverflowCount() >= g_eventCount;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (!parseArgs(argc, argv))
+		return 1;
+
+	uint32_t written = 0;
+	uint64_t loops = 0;
+	uint64_t occupancySum = 0;
+	int occupancyMax = 0;
+
+	while (!done() && sim_now_us() < TIMEOUT_US)
+	{
+		USBMIDI.poll();
+
+		int occupancy = 0;
+		for (uint8_t cable=0; cable<USBMIDI_CABLE_COUNT; ++cable)
+		{
+			USBMIDIPort &port = USBMIDI[cable];
+			occupancy += port.availableEvents();
+
+			midi_event_t ev;
+			for (uint32_t n=0; (g_readBatch == 0 || n < g_readBatch) && port.readEvent(ev); ++n)
+			{
+				if (!isClock(ev))
+					checkSeq(g_sketchExpected[cable], ev);
+				++g_sketchRead;
+
+				if (g_scenario == SCENARIO_ECHO)
+					port.writeEvent(ev);
+			}
+		}
+
+		if (g_scenario == SCENARIO_OUT && written < g_eventCount)
+		{
+			uint8_t cable = written % USBMIDI_CABLE_COUNT;
+			midi_event_t ev = makeNote(cable, written / USBMIDI_CABLE_COUNT);
+			USBMIDI[cable].write(ev.m_data, 3);
+			if (++written == g_eventCount)
+				USBMIDI.flush();
+		}
+
+		occupancySum += occupancy;
+		if (occupancy > occupancyMax)
+			occupancyMax = occupancy;
+		++loops;
+
+		sim_advance(g_loopUs);
+	}
+
+	static const char *const SCENARIO_NAMES[] = { "out", "in", "echo" };
+
+	double seconds = sim_now_us() / 1e6;
+	uint32_t events = g_scenario == SCENARIO_IN ? g_sketchRead : g_hostReceived;
+
+	printf("transport            %s, %d cable(s), %d byte config descriptor\n", sim_transport_name(), USBMIDI_CABLE_COUNT,
+		sim_transport_descriptor_size());
+	printf("scenario             %s, %u events, loop %u us, read batch %u, host rate %u/s\n",
+		SCENARIO_NAMES[g_scenario], g_eventCount, g_loopUs, g_readBatch, g_hostRate);
+	printf("simulated time       %.3f s%s\n", seconds, done() ? "" : " (timed out)");
+	printf("delivered            %u events, %.0f events/s\n", events, seconds > 0 ? events / seconds : 0.0);
+	printf("packets              %llu out, %llu in, %llu NAKed\n", (unsigned long long)g_simStats.m_outPackets,
+		(unsigned long long)g_simStats.m_inPackets, (unsigned long long)g_simStats.m_naks);
+	printf("dropped              %u events\n", USBMIDI.getOverflowCount());
+	printf("sequence errors      %u\n", g_sequenceErrors);
+	printf("input occupancy      max %d, avg %.2f events\n", occupancyMax, loops ? (double)occupancySum / loops : 0.0);
+	printf("blocked on IN        %.3f ms\n", g_simStats.m_blockedUs / 1e3);
+
+	return done() ? 0 : 2;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include "sim.h"
+
+#include <Arduino.h>
+
+uint32_t g_simPollCostUs = 2;
+sim_stats_t g_simStats;
+
+static uint64_t g_now;
+static uint64_t g_nextService;
+
+uint64_t sim_now_us()
+{
+	return g_now;
+}
+
+void sim_advance(uint32_t us)
+{
+	uint64_t target = g_now + us;
+
+	while (g_nextService <= target)
+	{
+		g_now = g_nextService;
+		g_nextService += sim_transport_interval_us();
+		sim_transport_service();
+	}
+
+	g_now = target;
+}
+
+unsigned long millis()
+{
+	return (unsigned long)(g_now / 1000);
+}
+
+unsigned long micros()
+{
+	return (unsigned long)g_now;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+#include "midi_serialization.h"
+
+// Simulated time in microseconds. It advances only when the sketch loop spends time, or when
+// the transport waits for the host, so results don't depend on the speed of the host machine.
+uint64_t sim_now_us();
+void sim_advance(uint32_t us);
+
+// Cost of a single usbPoll() / USB_Send() bank wait step, in simulated microseconds.
+extern uint32_t g_simPollCostUs;
+
+struct sim_stats_t
+{
+	uint64_t m_hostSentEvents;     // Events taken by the device from the host.
+	uint64_t m_hostReceivedEvents; // Events delivered to the host.
+	uint64_t m_outPackets;         // Host to device packets.
+	uint64_t m_inPackets;          // Device to host packets.
+	uint64_t m_naks;               // Host to device packets refused by the device.
+	uint64_t m_blockedUs;          // Time the sketch spent waiting for the IN endpoint.
+};
+
+extern sim_stats_t g_simStats;
+
+// Implemented by the transport, sim_pluggableusb.cpp or sim_vusb.cpp.
+
+// Name and host polling interval, in microseconds.
+const char *sim_transport_name();
+uint32_t sim_transport_interval_us();
+
+// Runs the host's side of a single polling interval.
+void sim_transport_service();
+
+// Returns the size of the configuration descriptors as seen by the host.
+int sim_transport_descriptor_size();
+
+// Implemented by the scenario driver, main.cpp.
+
+// Returns false if the host has nothing to send at the moment.
+bool sim_host_has_out();
+bool sim_host_next_out(midi_event_t &ev);
+void sim_host_received(const midi_event_t &ev);
+
+#endif // SIM_H
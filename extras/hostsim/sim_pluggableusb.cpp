@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Full speed USB device controller of ATmega32U4, as used through the Arduino core.
+//
+// The bulk OUT endpoint has a single 64 byte bank, which the host fills only once the sketch
+// has read all of it. The bulk IN endpoint has two 64 byte banks. As in the core, USB_Send()
+// hands a bank to the host only once it's full, or at the end of the call if TRANSFER_RELEASE
+// is passed, otherwise a partial bank waits for USB_Flush(). It waits for the host to take a
+// bank when both are in use. The host serves each endpoint once per polling interval.
+
+#include "sim.h"
+
+#include <PluggableUSB.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_IN_BANKS 2
+
+// Full speed bulk transfers can get served many times per 1 ms frame.
+static const uint32_t HOST_INTERVAL_US = 125;
+
+static PluggableUSB_ g_pluggableUsb;
+
+static uint8_t g_outBank[USB_EP_SIZE];
+static uint8_t g_outLength;
+static uint8_t g_outPosition;
+
+struct in_bank_t
+{
+	uint8_t m_data[USB_EP_SIZE];
+	uint8_t m_length;
+	bool m_released;
+};
+
+static in_bank_t g_inBanks[SIM_IN_BANKS];
+static uint8_t g_inFront; // Oldest bank, next to be taken by the host.
+static uint8_t g_inCount; // Banks in use, including the one being filled.
+
+static uint8_t *g_controlBuffer;
+static int g_controlSize;
+static int g_controlLength;
+
+PluggableUSB_ &PluggableUSB()
+{
+	return g_pluggableUsb;
+}
+
+bool PluggableUSB_::plug(PluggableUSBModule *node)
+{
+	// Interface 0 and endpoint 0 are taken by the core.
+	m_module = node;
+	node->pluggedInterface = 0;
+	node->pluggedEndpoint = 1;
+	return true;
+}
+
+int PluggableUSB_::getInterface(uint8_t *buffer, int size)
+{
+	g_controlBuffer = buffer;
+	g_controlSize = size;
+	g_controlLength = 0;
+
+	uint8_t interfaceCount = 0;
+	int res = m_module->getInterface(&interfaceCount);
+
+	g_controlBuffer = NULL;
+	return res < 0 ? res : g_controlLength;
+}
+
+int USB_SendControl(uint8_t flags, const void *d, int len)
+{
+	(void)flags;
+	if (g_controlBuffer == NULL || g_controlLength + len > g_controlSize)
+		return -1;
+
+	memcpy(&g_controlBuffer[g_controlLength], d, len);
+	g_controlLength += len;
+	return len;
+}
+
+static in_bank_t &fillingBank()
+{
+	return g_inBanks[(g_inFront + g_inCount - 1) % SIM_IN_BANKS];
+}
+
+static void releaseInBank()
+{
+	if (g_inCount != 0 && !fillingBank().m_released && fillingBank().m_length != 0)
+		fillingBank().m_released = true;
+}
+
+// Makes sure there's an unreleased bank to write into, waiting for the host if necessary.
+static in_bank_t &writableInBank()
+{
+	while (g_inCount == SIM_IN_BANKS && fillingBank().m_released)
+	{
+		sim_advance(g_simPollCostUs);
+		g_simStats.m_blockedUs += g_simPollCostUs;
+	}
+
+	if (g_inCount == 0 || fillingBank().m_released)
+	{
+		++g_inCount;
+		fillingBank().m_length = 0;
+		fillingBank().m_released = false;
+	}
+
+	return fillingBank();
+}
+
+int USB_Send(uint8_t ep, const void *data, int len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	int remaining = len;
+
+	while (remaining)
+	{
+		in_bank_t &bank = writableInBank();
+
+		int n = USB_EP_SIZE - bank.m_length;
+		if (n > remaining)
+			n = remaining;
+
+		memcpy(&bank.m_data[bank.m_length], p, n);
+		bank.m_length += n;
+		p += n;
+		remaining -= n;
+
+		if (bank.m_length == USB_EP_SIZE)
+			bank.m_released = true;
+	}
+
+	if (ep & TRANSFER_RELEASE)
+		releaseInBank();
+	return len;
+}
+
+uint8_t USB_SendSpace(uint8_t ep)
+{
+	(void)ep;
+	if (g_inCount == 0)
+		return USB_EP_SIZE;
+
+	if (fillingBank().m_released)
+		return g_inCount < SIM_IN_BANKS ? USB_EP_SIZE : 0;
+
+	return USB_EP_SIZE - fillingBank().m_length;
+}
+
+void USB_Flush(uint8_t ep)
+{
+	(void)ep;
+	releaseInBank();
+}
+
+uint8_t USB_Available(uint8_t ep)
+{
+	(void)ep;
+	return g_outLength - g_outPosition;
+}
+
+int USB_Recv(uint8_t ep, void *data, int len)
+{
+	(void)ep;
+	int n = g_outLength - g_outPosition;
+	if (n > len)
+		n = len;
+
+	memcpy(data, &g_outBank[g_outPosition], n);
+	g_outPosition += n;
+	return n;
+}
+
+int USB_Recv(uint8_t ep)
+{
+	uint8_t c;
+	if (USB_Recv(ep, &c, 1) != 1)
+		return -1;
+	return c;
+}
+
+const char *sim_transport_name()
+{
+	return "pluggableusb";
+}
+
+uint32_t sim_transport_interval_us()
+{
+	return HOST_INTERVAL_US;
+}
+
+void sim_transport_service()
+{
+	// IN: take the oldest released bank.
+	if (g_inCount != 0 && g_inBanks[g_inFront].m_released)
+	{
+		in_bank_t &bank = g_inBanks[g_inFront];
+		for (uint8_t i=0; i+sizeof(midi_event_t)<=bank.m_length; i+=sizeof(midi_event_t))
+		{
+			midi_event_t ev;
+			memcpy(&ev, &bank.m_data[i], sizeof(ev));
+			sim_host_received(ev);
+		}
+
+		g_inFront = (g_inFront + 1) % SIM_IN_BANKS;
+		--g_inCount;
+		++g_simStats.m_inPackets;
+		g_simStats.m_hostReceivedEvents += bank.m_length / sizeof(midi_event_t);
+	}
+
+	// OUT: refill the bank once the sketch has read all of it.
+	if (g_outPosition != g_outLength)
+	{
+		if (sim_host_has_out())
+			++g_simStats.m_naks;
+		return;
+	}
+
+	uint8_t length = 0;
+	midi_event_t ev;
+	while (length < USB_EP_SIZE && sim_host_next_out(ev))
+	{
+		memcpy(&g_outBank[length], &ev, sizeof(ev));
+		length += sizeof(ev);
+		++g_simStats.m_hostSentEvents;
+	}
+
+	if (length)
+	{
+		g_outLength = length;
+		g_outPosition = 0;
+		++g_simStats.m_outPackets;
+	}
+}
+
+int sim_transport_descriptor_size()
+{
+	uint8_t buffer[1024];
+	return PluggableUSB().getInterface(buffer, sizeof(buffer));
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Low speed V-USB device, as seen through usbdrv.h.
+//
+// The host sends keep-alives every 1 ms, counted in usbSofCount, and serves the interrupt
+// endpoints once per USB_CFG_INTR_POLL_INTERVAL frames. An IN packet set up by
+// usbSetInterrupt() or usbSetInterrupt3() is taken at the next service of its endpoint. An
+// OUT packet of up to 8 bytes is accepted while the receive buffer is free, and is handed to
+// usbFunctionWriteOut() by the next usbPoll(). While requests are disabled, OUT packets are
+// NAKed and retried at the next interval.
+
+#include "sim.h"
+
+#include <string.h>
+
+static const uint32_t FRAME_US = 1000;
+
+volatile uint8_t sim_usb_port;
+volatile uint8_t sim_usb_ddr;
+
+volatile uchar usbTxLen1 = USBPID_NAK;
+volatile uchar usbTxLen3 = USBPID_NAK;
+volatile schar usbRxLen;
+volatile uchar usbSofCount;
+usbMsgPtr_t usbMsgPtr;
+
+static uchar g_txBuf1[8];
+static uchar g_txBuf3[8];
+static uchar g_rxBuf[8];
+
+static uint32_t g_frame;
+
+void usbInit(void)
+{
+	usbTxLen1 = USBPID_NAK;
+	usbTxLen3 = USBPID_NAK;
+	usbRxLen = 0;
+}
+
+void usbPoll(void)
+{
+	sim_advance(g_simPollCostUs);
+
+	if (usbRxLen > 0)
+	{
+		usbFunctionWriteOut(g_rxBuf, usbRxLen);
+
+		// As in usbdrv.c, usbFunctionWriteOut() may have disabled further requests.
+		if (usbRxLen > 0)
+			usbRxLen = 0;
+	}
+}
+
+// The length is stored with the PID and CRC bytes, clearing the ready bit.
+void usbSetInterrupt(uchar *data, uchar len)
+{
+	memcpy(g_txBuf1, data, len);
+	usbTxLen1 = len + 4;
+}
+
+void usbSetInterrupt3(uchar *data, uchar len)
+{
+	memcpy(g_txBuf3, data, len);
+	usbTxLen3 = len + 4;
+}
+
+const char *sim_transport_name()
+{
+	return "vusb";
+}
+
+uint32_t sim_transport_interval_us()
+{
+	return FRAME_US;
+}
+
+// With USBMIDI_VUSB_DUAL_IN, cables are numbered within their endpoint, even ones on endpoint 1
+// and odd ones on endpoint 3, the host maps them back using the descriptors.
+static void serviceIn(volatile uchar &txLen, const uchar *buffer, uint8_t endpointCable)
+{
+	if (txLen & 0x10)
+		return;
+
+	uint8_t length = txLen - 4;
+	for (uint8_t i=0; i+sizeof(midi_event_t)<=length; i+=sizeof(midi_event_t))
+	{
+		midi_event_t ev;
+		memcpy(&ev, &buffer[i], sizeof(ev));
+#if USBMIDI_VUSB_DUAL_IN
+		ev.m_event = ((ev.m_event & 0xf0) << 1) | (endpointCable << 4) | (ev.m_event & 0x0f);
+#endif
+		sim_host_received(ev);
+		++g_simStats.m_hostReceivedEvents;
+	}
+
+	txLen = USBPID_NAK;
+	++g_simStats.m_inPackets;
+}
+
+void sim_transport_service()
+{
+	++usbSofCount;
+
+	if (g_frame++ % USB_CFG_INTR_POLL_INTERVAL)
+		return;
+
+	serviceIn(usbTxLen1, g_txBuf1, 0);
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+	serviceIn(usbTxLen3, g_txBuf3, 1);
+#endif
+
+	if (!sim_host_has_out())
+		return;
+
+	if (usbRxLen != 0)
+	{
+		++g_simStats.m_naks;
+		return;
+	}
+
+	uint8_t length = 0;
+	midi_event_t ev;
+	while (length < sizeof(g_rxBuf) && sim_host_next_out(ev))
+	{
+		memcpy(&g_rxBuf[length], &ev, sizeof(ev));
+		length += sizeof(ev);
+		++g_simStats.m_hostSentEvents;
+	}
+
+	usbRxLen = length;
+	++g_simStats.m_outPackets;
+}
+
+int sim_transport_descriptor_size()
+{
+	usbRequest_t rq;
+	memset(&rq, 0, sizeof(rq));
+	rq.wValue.bytes[1] = USBDESCR_CONFIG;
+	return usbFunctionDescriptor(&rq);
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Host stand-in for the Arduino core. Time is simulated, see sim.h.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "Stream.h"
+
+typedef uint8_t u8;
+
+unsigned long millis();
+unsigned long micros();
+
+inline void cli() {}
+inline void sei() {}
+
+#endif // Arduino_h
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Host stand-in for the Arduino AVR core's PluggableUSB and USB endpoint API, implemented
+// by sim_pluggableusb.cpp.
+
+#ifndef PUSB_h
+#define PUSB_h
+
+#include "Arduino.h"
+
+#define USB_EP_SIZE      64
+#define TRANSFER_PGM     0x80
+#define TRANSFER_RELEASE 0x40
+#define TRANSFER_ZERO    0x20
+
+#define EP_TYPE_BULK_OUT 0
+#define EP_TYPE_BULK_IN  1
+
+struct USBSetup
+{
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+	uint8_t wValueL;
+	uint8_t wValueH;
+	uint16_t wIndex;
+	uint16_t wLength;
+};
+
+class PluggableUSBModule
+{
+public:
+	PluggableUSBModule(uint8_t numEps, uint8_t numIfs, uint8_t *epType)
+		:numEndpoints(numEps)
+		,numInterfaces(numIfs)
+		,endpointType(epType)
+		,pluggedInterface(0)
+		,pluggedEndpoint(0)
+	{
+	}
+
+protected:
+	virtual bool setup(USBSetup &setup) = 0;
+	virtual int getInterface(uint8_t *interfaceCount) = 0;
+	virtual int getDescriptor(USBSetup &setup) = 0;
+
+	uint8_t numEndpoints;
+	uint8_t numInterfaces;
+	const uint8_t *endpointType;
+
+	uint8_t pluggedInterface;
+	uint8_t pluggedEndpoint;
+
+	friend class PluggableUSB_;
+};
+
+class PluggableUSB_
+{
+public:
+	bool plug(PluggableUSBModule *node);
+
+	// Simulation only, returns the interface descriptors of the plugged module, as sent
+	// during enumeration.
+	int getInterface(uint8_t *buffer, int size);
+
+private:
+	PluggableUSBModule *m_module;
+};
+
+PluggableUSB_ &PluggableUSB();
+
+int USB_SendControl(uint8_t flags, const void *d, int len);
+int USB_Send(uint8_t ep, const void *data, int len);
+int USB_Recv(uint8_t ep, void *data, int len);
+int USB_Recv(uint8_t ep);
+uint8_t USB_Available(uint8_t ep);
+uint8_t USB_SendSpace(uint8_t ep);
+void USB_Flush(uint8_t ep);
+
+#endif // PUSB_h
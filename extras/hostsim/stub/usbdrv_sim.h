@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+// Host stand-in for V-USB's usbdrv.h, implemented by sim_vusb.cpp. It's force included
+// ahead of the library sources, taking the include guard of the real header, so that
+// src/usbdrv.h compiles unchanged.
+
+#ifndef __usbdrv_h_included__
+#define __usbdrv_h_included__
+
+#include <stdint.h>
+
+#include "usbconfig.h"
+
+typedef uint8_t uchar;
+typedef int8_t schar;
+
+// The library casts descriptor pointers to usbMsgPtr_t, which is 16 bit on AVR.
+#undef usbMsgPtr_t
+#define usbMsgPtr_t uintptr_t
+
+#if USB_CFG_LONG_TRANSFERS
+typedef uint16_t usbMsgLen_t;
+#else
+typedef uint8_t usbMsgLen_t;
+#endif
+
+typedef union usbWord
+{
+	unsigned word;
+	uchar *ptr;
+	uchar bytes[2];
+} usbWord_t;
+
+typedef struct usbRequest
+{
+	uchar bmRequestType;
+	uchar bRequest;
+	usbWord_t wValue;
+	usbWord_t wIndex;
+	usbWord_t wLength;
+} usbRequest_t;
+
+#define USBDESCR_DEVICE    1
+#define USBDESCR_CONFIG    2
+#define USBDESCR_STRING    3
+#define USBDESCR_INTERFACE 4
+#define USBDESCR_ENDPOINT  5
+
+#define USBATTR_BUSPOWER   0x80
+#define USBATTR_SELFPOWER  0x40
+
+#define USBPID_NAK         0x5a
+
+extern volatile uint8_t sim_usb_port;
+extern volatile uint8_t sim_usb_ddr;
+
+#define USB_CFG_IOPORT sim_usb_port
+#define USBDDR         sim_usb_ddr
+
+extern volatile uchar usbTxLen1;
+extern volatile uchar usbTxLen3;
+extern volatile schar usbRxLen;
+extern volatile uchar usbSofCount;
+extern usbMsgPtr_t usbMsgPtr;
+
+#define usbInterruptIsReady()       (usbTxLen1 & 0x10)
+#define usbInterruptIsReady3()      (usbTxLen3 & 0x10)
+#define usbDisableAllRequests()     usbRxLen = -1
+#define usbEnableAllRequests()      usbRxLen = 0
+#define usbAllRequestsAreDisabled() (usbRxLen < 0)
+
+void usbInit(void);
+void usbPoll(void);
+void usbSetInterrupt(uchar *data, uchar len);
+void usbSetInterrupt3(uchar *data, uchar len);
+
+usbMsgLen_t usbFunctionDescriptor(usbRequest_t *rq);
+uchar usbFunctionSetup(uchar data[8]);
+void usbFunctionWriteOut(uchar *data, uchar len);
+
+#endif // __usbdrv_h_included__
@@ -0,0 +1,9 @@
+// Baseline for extras/sizes, the Arduino core without USBMIDI.
+
+void setup()
+{
+}
+
+void loop()
+{
+}
@@ -0,0 +1,21 @@
+// Sketch measured by extras/sizes, using both the byte and the event interface of USBMIDI.
+
+#include <usbmidi.h>
+
+void setup()
+{
+}
+
+void loop()
+{
+	USBMIDI.poll();
+
+	while (USBMIDI.available())
+		USBMIDI.write(USBMIDI.read());
+
+	midi_event_t ev;
+	if (USBMIDI.readEvent(ev))
+		USBMIDI.writeEvent(ev);
+
+	USBMIDI.flush();
+}
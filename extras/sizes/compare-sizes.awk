@@ -0,0 +1,18 @@
+#!/usr/bin/awk -f
+# Usage: compare-sizes.awk reference current
+# Prints the flash and RAM difference of each board and variation present in both files.
+
+FNR == 1 { next }
+
+FILENAME == ARGV[1] {
+	flash[$1, $2] = $3
+	ram[$1, $2] = $4
+	next
+}
+
+{
+	if (!(($1, $2) in flash) || flash[$1, $2] == "n/a" || $3 == "n/a")
+		printf("%-11s %-32s %6s %5s\n", $1, $2, "n/a", "n/a")
+	else
+		printf("%-11s %-32s %+6d %+5d\n", $1, $2, $3 - flash[$1, $2], $4 - ram[$1, $2])
+}
@@ -0,0 +1,86 @@
+#!/bin/sh
+# Builds SizeSketch for each board and library configuration with arduino-cli and prints the
+# flash and RAM used by USBMIDI, with the size of NullSketch on the same board subtracted.
+# +F and +RAM are relative to the default configuration of the board.
+#
+# Environment: ARDUINO_CLI - arduino-cli binary, BUILD_DIR - scratch directory for the builds.
+
+ARDUINO_CLI=${ARDUINO_CLI:-arduino-cli}
+BUILD_DIR=${BUILD_DIR:-/tmp/usbmidi-sizes}
+LIBRARY=$(cd "$(dirname "$0")/../.." && pwd)
+HERE=$(cd "$(dirname "$0")" && pwd)
+
+if ! command -v "$ARDUINO_CLI" >/dev/null 2>&1; then
+	echo "$ARDUINO_CLI not found, set ARDUINO_CLI to its path." >&2
+	exit 1
+fi
+
+# compile <fqbn> <sketch> <defines...>, prints "flash ram", or nothing if the build fails.
+compile()
+{
+	fqbn=$1
+	sketch=$2
+	shift 2
+	flags="$*"
+	"$ARDUINO_CLI" compile --fqbn "$fqbn" --library "$LIBRARY" --clean \
+		--build-path "$BUILD_DIR/$(echo "$fqbn" | tr : _)" \
+		--build-property "compiler.c.extra_flags=$flags" \
+		--build-property "compiler.cpp.extra_flags=$flags" \
+		--build-property "compiler.S.extra_flags=$flags" \
+		"$HERE/$sketch" 2>/dev/null | \
+		awk '/^Sketch uses/{ flash=$3 } /^Global variables use/{ ram=$4 } END{ if (flash != "") print flash, ram }'
+}
+
+# board <name> <fqbn>, reads "variation defines..." lines from stdin.
+board()
+{
+	name=$1
+	fqbn=$2
+	null=$(compile "$fqbn" NullSketch)
+	if [ -z "$null" ]; then
+		echo "$name: can't build for $fqbn, is its core installed?" >&2
+		return
+	fi
+
+	while read -r variation defines; do
+		size=$(compile "$fqbn" SizeSketch $defines)
+		echo "$name $variation ${size:-n/a n/a} $null"
+	done
+}
+
+vusb_variations()
+{
+	for events in 15 3 7 31; do
+		echo "${events}_Events -DUSBMIDI_VUSB_IN_EVENTS=$events -DUSBMIDI_VUSB_OUT_EVENTS=$events"
+		echo "${events}_Events+Suspend_Resume -DUSBMIDI_VUSB_IN_EVENTS=$events -DUSBMIDI_VUSB_OUT_EVENTS=$events -DUSB_COUNT_SOF=1"
+	done
+	echo "No_Flow_Control -DUSBMIDI_VUSB_FLOW_CONTROL=0"
+	echo "2_Cables -DUSBMIDI_CABLE_COUNT=2"
+	echo "2_Cables+Dual_IN -DUSBMIDI_CABLE_COUNT=2 -DUSBMIDI_VUSB_DUAL_IN=1"
+}
+
+pluggableusb_variations()
+{
+	for bytes in 64 32 128 256; do
+		echo "${bytes}_Byte_Input -DUSBMIDI_IN_BUFFER_SIZE=$bytes"
+	done
+	echo "Lossless_RX -DUSBMIDI_LOSSLESS_RX=1"
+	echo "Unpacked_TX -DUSBMIDI_TX_LATENCY_MS=0"
+	echo "2_Cables -DUSBMIDI_CABLE_COUNT=2"
+}
+
+{
+	vusb_variations | board Digispark digistump:avr:digispark-tiny
+	vusb_variations | board ATmega328P arduino:avr:uno
+	pluggableusb_variations | board ATmega32U4 arduino:avr:leonardo
+} | awk 'BEGIN{ printf("%-11s %-32s %5s %5s %5s %5s\n", "Board", "Variation", "Flash", "RAM", "+F", "+RAM") }
+	{
+		if ($3 == "n/a") { printf("%-11s %-32s %5s %5s %5s %5s\n", $1, $2, "n/a", "n/a", "", ""); next }
+		flash = $3 - $5; ram = $4 - $6
+		if ($1 != board) { check(); board = $1; refFlash = flash; refRam = ram; changed = 0 }
+		if (flash != refFlash || ram != refRam) changed = 1
+		printf("%-11s %-32s %5d %5d %+5d %+5d\n", $1, $2, flash, ram, flash - refFlash, ram - refRam)
+	}
+	# Every variation changes the code, if none did the defines did not reach the compiler.
+	function check() { if (board != "" && !changed) { print board ": all variations have the same size, were the defines applied?" > "/dev/stderr"; failed = 1 } }
+	END{ check(); exit failed }'
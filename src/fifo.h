@@ -27,10 +27,28 @@ public:
 	bool pop(T &item);
 	void push(T item);
 
+	// Access to the queued items, 0 being the front one, i must be less than size().
+	T &operator[](IndexType i);
+
+	// Bulk versions, items are copied with memcpy. Return the count of items pushed or popped,
+	// which is less than n if the queue fills up or runs empty.
+	IndexType push(const T *items, IndexType n);
+	IndexType pop(T *items, IndexType n);
+
+	// Zero-copy access. The spans cover the contiguous free or filled region up to the point
+	// where the buffer wraps, so a full transfer may take two span and commit rounds. The
+	// count passed to commit may not exceed the size of the span returned.
+	T *writableSpan(IndexType &n);
+	void commitWrite(IndexType n);
+	const T *readableSpan(IndexType &n) const;
+	void commitRead(IndexType n);
+
 	bool hasSpaceFor(IndexType n) const;
 
 private:
 	IndexType next(IndexType i) const;
+	// (i + n) % N for i < N and n <= N, without overflowing the index type.
+	IndexType add(IndexType i, IndexType n) const;
 
 	T m_items[N];
 	IndexType m_front;
@@ -102,6 +120,85 @@ inline void TFifo<T, IndexType, N>::push(T item)
 	m_back = next(m_back);
 }
 
+template <typename T, typename IndexType, const IndexType N>
+inline T &TFifo<T, IndexType, N>::operator[](IndexType i)
+{
+	return m_items[add(m_front, i)];
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline IndexType TFifo<T, IndexType, N>::push(const T *items, IndexType n)
+{
+	IndexType done = 0;
+	while (done < n)
+	{
+		IndexType count;
+		T *span = writableSpan(count);
+		if (count == 0)
+			break;
+
+		if (count > n - done)
+			count = n - done;
+
+		memcpy(span, items + done, count * sizeof(T));
+		commitWrite(count);
+		done += count;
+	}
+	return done;
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline IndexType TFifo<T, IndexType, N>::pop(T *items, IndexType n)
+{
+	IndexType done = 0;
+	while (done < n)
+	{
+		IndexType count;
+		const T *span = readableSpan(count);
+		if (count == 0)
+			break;
+
+		if (count > n - done)
+			count = n - done;
+
+		memcpy(items + done, span, count * sizeof(T));
+		commitRead(count);
+		done += count;
+	}
+	return done;
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline T *TFifo<T, IndexType, N>::writableSpan(IndexType &n)
+{
+	// One slot before m_front is always kept free, to tell a full queue from an empty one.
+	if (m_back >= m_front)
+		n = (m_front == 0 ? N - 1 : N) - m_back;
+	else
+		n = m_front - 1 - m_back;
+
+	return &m_items[m_back];
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline void TFifo<T, IndexType, N>::commitWrite(IndexType n)
+{
+	m_back = add(m_back, n);
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline const T *TFifo<T, IndexType, N>::readableSpan(IndexType &n) const
+{
+	n = (m_back >= m_front ? m_back : N) - m_front;
+	return &m_items[m_front];
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline void TFifo<T, IndexType, N>::commitRead(IndexType n)
+{
+	m_front = add(m_front, n);
+}
+
 template <typename T, typename IndexType, const IndexType N>
 inline bool TFifo<T, IndexType, N>::hasSpaceFor(IndexType n) const
 {
@@ -114,4 +211,144 @@ inline IndexType TFifo<T, IndexType, N>::next(IndexType i) const
 	return (i + 1) % N;
 }
 
+template <typename T, typename IndexType, const IndexType N>
+inline IndexType TFifo<T, IndexType, N>::add(IndexType i, IndexType n) const
+{
+	return i >= N - n ? i - (N - n) : i + n;
+}
+
+// Single producer, single consumer ring buffer, safe to share between an interrupt handler
+// and the main loop as long as only one side pushes and only the other side pops. The
+// capacity N must be a power of two, all N slots are usable. The indices run freely and get
+// masked on access, each side only writes its own index and publishes it after the item
+// memory it guards is written or read.
+//
+// The items are not cleared on construction, so large buffers placed in .bss cost nothing
+// during static initialization.
+template <typename T, typename IndexType, const IndexType N>
+class TSpscFifo
+{
+public:
+	TSpscFifo();
+
+	// Safe to call from either side.
+	bool empty() const;
+	bool full() const;
+	IndexType size() const;
+
+	// Consumer side.
+	bool peek(T &item) const;
+	void advance();
+	bool pop(T &item);
+
+	// Producer side, returns false if the queue is full.
+	bool push(const T &item);
+
+	bool hasSpaceFor(IndexType n) const;
+
+private:
+	static_assert(N > 0 && (N & (N - 1)) == 0, "TSpscFifo capacity must be a power of two!");
+	static_assert(N <= (IndexType)~(IndexType)0 / 2 + 1, "TSpscFifo capacity too large for the index type!");
+#ifdef __AVR__
+	static_assert(sizeof(IndexType) == 1, "Only single byte indices are accessed atomically on AVR!");
+#endif
+
+	enum { MASK = N - 1 };
+
+	static IndexType load(const IndexType &index);
+	static void store(IndexType &index, IndexType value);
+
+	T m_items[N];
+	IndexType m_front;
+	IndexType m_back;
+};
+
+template <typename T, typename IndexType, const IndexType N>
+inline TSpscFifo<T, IndexType, N>::TSpscFifo()
+	:m_front(0)
+	,m_back(0)
+{
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline IndexType TSpscFifo<T, IndexType, N>::load(const IndexType &index)
+{
+	return __atomic_load_n(&index, __ATOMIC_ACQUIRE);
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline void TSpscFifo<T, IndexType, N>::store(IndexType &index, IndexType value)
+{
+	__atomic_store_n(&index, value, __ATOMIC_RELEASE);
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline bool TSpscFifo<T, IndexType, N>::empty() const
+{
+	return load(m_front) == load(m_back);
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline bool TSpscFifo<T, IndexType, N>::full() const
+{
+	return size() == N;
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline IndexType TSpscFifo<T, IndexType, N>::size() const
+{
+	return (IndexType)(load(m_back) - load(m_front));
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline bool TSpscFifo<T, IndexType, N>::peek(T &item) const
+{
+	IndexType front = m_front;
+	if (front == load(m_back))
+		return false;
+
+	item = m_items[front & MASK];
+	return true;
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline void TSpscFifo<T, IndexType, N>::advance()
+{
+	IndexType front = m_front;
+	if (front == load(m_back))
+		return;
+
+	store(m_front, front + 1);
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline bool TSpscFifo<T, IndexType, N>::pop(T &item)
+{
+	IndexType front = m_front;
+	if (front == load(m_back))
+		return false;
+
+	item = m_items[front & MASK];
+	store(m_front, front + 1);
+	return true;
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline bool TSpscFifo<T, IndexType, N>::push(const T &item)
+{
+	IndexType back = m_back;
+	if ((IndexType)(back - load(m_front)) == N)
+		return false;
+
+	m_items[back & MASK] = item;
+	store(m_back, back + 1);
+	return true;
+}
+
+template <typename T, typename IndexType, const IndexType N>
+inline bool TSpscFifo<T, IndexType, N>::hasSpaceFor(IndexType n) const
+{
+	return N - size() >= n;
+}
+
 #endif // FIFO_H
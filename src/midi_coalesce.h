@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef MIDI_COALESCE_H
+#define MIDI_COALESCE_H
+
+#include "midi_messages.h"
+#include "midi_serialization.h"
+
+// Output coalescing: a Control Change, Pitch Bend or Pressure message which is still waiting to
+// be sent gets its value replaced by a newer message for the same cable, channel and controller
+// (or note, for Polyphonic Key Pressure), instead of queueing both. Useful when a sketch sends
+// controller values faster than the host reads them, like from a potentiometer in every loop.
+#ifndef USBMIDI_COALESCE
+#define USBMIDI_COALESCE 0
+#endif
+
+// Controllers which are part of multi-message sequences, their order and count must be kept:
+// Bank Select, Data Entry, Data Increment / Decrement, (N)RPN selection and Channel Mode messages.
+inline bool midi_is_sequenced_controller(uint8_t controller)
+{
+	return controller == 0 || controller == 6 || controller == 32 || controller == 38 ||
+		(controller >= 96 && controller <= 101) || controller >= 120;
+}
+
+inline bool midi_is_coalescable(const midi_event_t &ev)
+{
+	switch (ev.m_event & 0x0f)
+	{
+	case 0xa: // Polyphonic Key Pressure.
+	case 0xd: // Channel Pressure.
+	case 0xe: // Pitch Bend.
+		return true;
+	case 0xb: // Control Change.
+		return !midi_is_sequenced_controller(ev.m_data[1]);
+	default:
+		return false;
+	}
+}
+
+// Returns true if newer replaces pending, both must be coalescable.
+inline bool midi_coalesce_match(const midi_event_t &pending, const midi_event_t &newer)
+{
+	if (pending.m_event != newer.m_event || pending.m_data[0] != newer.m_data[0])
+		return false;
+
+	uint8_t cin = newer.m_event & 0x0f;
+	return cin == 0xd || cin == 0xe || pending.m_data[1] == newer.m_data[1];
+}
+
+// Looks through the first count events, from the newest back, for a message which ev replaces,
+// and replaces it. The search stops at any message other than coalescable or Real-Time ones, so
+// the order relative to notes, SysEx and the rest is kept. Events can be an array or a TFifo.
+// Returns true if ev was merged and must not be queued.
+template <typename Events, typename Index>
+inline bool midi_coalesce(Events &events, Index count, const midi_event_t &ev)
+{
+	if (!midi_is_coalescable(ev))
+		return false;
+
+	while (count--)
+	{
+		midi_event_t &pending = events[count];
+
+		if (!midi_is_coalescable(pending))
+		{
+			if ((pending.m_event & 0x0f) == 0x0f && midi_is_real_time(pending.m_data[0]))
+				continue;
+
+			return false;
+		}
+
+		if (midi_coalesce_match(pending, ev))
+		{
+			pending = ev;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#endif // MIDI_COALESCE_H
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef MIDI_IN_FIFO_H
+#define MIDI_IN_FIFO_H
+
+#include "fifo.h"
+#include "midi_messages.h"
+#include "midi_serialization.h"
+#include "midi_sysex_receiver.h"
+
+// Queue of incoming USB MIDI events, readable both as whole events and as a MIDI byte stream.
+// Bytes are decoded from an event only once the byte reading reaches it. Remaining bytes of
+// an event which was partially consumed by read() stay readable by read(), readEvent() returns
+// the events following it. If a SysEx receiver is set, SysEx events are handed to it instead
+// of being queued.
+//
+// Real-Time messages are kept in a separate lane, read ahead of everything else, as MIDI allows
+// them anywhere in the stream, even within other messages. With a Real-Time callback set, they
+// are handed to it straight from the receive path instead.
+template <const uint8_t N>
+class TMidiInFifo
+{
+public:
+	TMidiInFifo();
+
+	// Returns false if the queue is full. Events without MIDI payload are ignored.
+	bool push(const midi_event_t &ev);
+
+	void setSysExReceiver(MidiSysExReceiver *receiver);
+	void setRealTimeCallback(void (*callback)(uint8_t byte));
+
+	bool full() const;
+
+	// Returns the count of events which can still be pushed, whichever kind they turn out to be.
+	uint8_t availableForWrite() const;
+
+	int available() const;
+	int read();
+	int peek();
+
+	int availableEvents() const;
+	bool readEvent(midi_event_t &ev);
+	bool peekEvent(midi_event_t &ev) const;
+
+private:
+	bool fetch();
+	bool popRealTime(midi_event_t &ev);
+
+	TFifo<midi_event_t, uint8_t, N> m_events;
+
+	uint8_t m_bytes[3];
+	uint8_t m_byteIndex;
+	uint8_t m_byteCount;
+
+	uint16_t m_available;
+
+	MidiSysExReceiver *m_sysExReceiver;
+
+	// Real-Time messages are single bytes, the rest of the event is the same for all of them.
+	enum { REAL_TIME_SIZE = 8 };
+	TFifo<uint8_t, uint8_t, REAL_TIME_SIZE> m_realTime;
+	uint8_t m_realTimeHeader;
+	void (*m_realTimeCallback)(uint8_t byte);
+};
+
+template <const uint8_t N>
+inline TMidiInFifo<N>::TMidiInFifo()
+	:m_byteIndex(0)
+	,m_byteCount(0)
+	,m_available(0)
+	,m_sysExReceiver(NULL)
+	,m_realTimeHeader(0x0f)
+	,m_realTimeCallback(NULL)
+{
+}
+
+template <const uint8_t N>
+inline bool TMidiInFifo<N>::push(const midi_event_t &ev)
+{
+	uint8_t n = midi_cin_length(ev.m_event);
+	if (n == 0)
+		return true;
+
+	if ((ev.m_event & 0x0f) == 0x0f && midi_is_real_time(ev.m_data[0]))
+	{
+		if (m_realTimeCallback)
+		{
+			m_realTimeCallback(ev.m_data[0]);
+			return true;
+		}
+
+		if (m_realTime.full())
+			return false;
+
+		m_realTime.push(ev.m_data[0]);
+		m_realTimeHeader = ev.m_event;
+		++m_available;
+		return true;
+	}
+
+	if (m_sysExReceiver && m_sysExReceiver->process(ev))
+		return true;
+
+	if (m_events.full())
+		return false;
+
+	m_events.push(ev);
+	m_available += n;
+	return true;
+}
+
+template <const uint8_t N>
+inline void TMidiInFifo<N>::setSysExReceiver(MidiSysExReceiver *receiver)
+{
+	m_sysExReceiver = receiver;
+}
+
+template <const uint8_t N>
+inline void TMidiInFifo<N>::setRealTimeCallback(void (*callback)(uint8_t byte))
+{
+	m_realTimeCallback = callback;
+}
+
+template <const uint8_t N>
+inline bool TMidiInFifo<N>::full() const
+{
+	return m_events.full();
+}
+
+template <const uint8_t N>
+inline uint8_t TMidiInFifo<N>::availableForWrite() const
+{
+	uint8_t n = N - 1 - m_events.size();
+
+	// Without a callback, Real-Time messages fill up their own lane.
+	if (!m_realTimeCallback)
+	{
+		uint8_t realTime = REAL_TIME_SIZE - 1 - m_realTime.size();
+		if (realTime < n)
+			n = realTime;
+	}
+
+	return n;
+}
+
+template <const uint8_t N>
+inline int TMidiInFifo<N>::available() const
+{
+	return m_available;
+}
+
+template <const uint8_t N>
+inline bool TMidiInFifo<N>::fetch()
+{
+	if (m_byteIndex != m_byteCount)
+		return true;
+
+	midi_event_t ev;
+	if (!m_events.pop(ev))
+		return false;
+
+	m_byteCount = UsbToMidi::process(ev, m_bytes);
+	m_byteIndex = 0;
+	return true;
+}
+
+template <const uint8_t N>
+inline int TMidiInFifo<N>::read()
+{
+	uint8_t byte;
+	if (m_realTime.pop(byte))
+	{
+		--m_available;
+		return byte;
+	}
+
+	if (!fetch())
+		return -1;
+
+	--m_available;
+	return m_bytes[m_byteIndex++];
+}
+
+template <const uint8_t N>
+inline int TMidiInFifo<N>::peek()
+{
+	uint8_t byte;
+	if (m_realTime.peek(byte))
+		return byte;
+
+	if (!fetch())
+		return -1;
+
+	return m_bytes[m_byteIndex];
+}
+
+template <const uint8_t N>
+inline int TMidiInFifo<N>::availableEvents() const
+{
+	return m_events.size() + m_realTime.size();
+}
+
+template <const uint8_t N>
+inline bool TMidiInFifo<N>::popRealTime(midi_event_t &ev)
+{
+	if (!m_realTime.pop(ev.m_data[0]))
+		return false;
+
+	ev.m_event = m_realTimeHeader;
+	ev.m_data[1] = 0;
+	ev.m_data[2] = 0;
+	--m_available;
+	return true;
+}
+
+template <const uint8_t N>
+inline bool TMidiInFifo<N>::readEvent(midi_event_t &ev)
+{
+	if (popRealTime(ev))
+		return true;
+
+	if (!m_events.pop(ev))
+		return false;
+
+	m_available -= midi_cin_length(ev.m_event);
+	return true;
+}
+
+template <const uint8_t N>
+inline bool TMidiInFifo<N>::peekEvent(midi_event_t &ev) const
+{
+	if (m_realTime.peek(ev.m_data[0]))
+	{
+		ev.m_event = m_realTimeHeader;
+		ev.m_data[1] = 0;
+		ev.m_data[2] = 0;
+		return true;
+	}
+
+	return m_events.peek(ev);
+}
+
+#endif // MIDI_IN_FIFO_H
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef MIDI_MERGER_H
+#define MIDI_MERGER_H
+
+#include "fifo.h"
+#include "midi_messages.h"
+#include "midi_serialization.h"
+#include "usbmidi.h"
+
+// Merges the MIDI streams of N sources, like serial ports and messages generated by the sketch,
+// into the output of a single USBMIDI port. Each source has its own serializer and a queue of Q
+// complete events, so bytes of different sources never mix within a message. Queued events are
+// sent by poll(), picking the sources in turns (ROUND_ROBIN) or always the lowest numbered source
+// with data (PRIORITY), for as long as the port has room for them. Once a source begins sending
+// SysEx, the others wait until it ends, as no other messages may appear within it, a SysEx cut
+// short by another message of the same source is closed with 0xF7. Real-Time messages skip the
+// queues and are sent right away.
+template <const uint8_t N, const uint8_t Q = 8>
+class TMidiMerger
+{
+public:
+	enum Scheduling
+	{
+		ROUND_ROBIN,
+		PRIORITY
+	};
+
+	explicit TMidiMerger(USBMIDIPort &port = USBMIDI, Scheduling scheduling = ROUND_ROBIN);
+
+	void setScheduling(Scheduling scheduling);
+
+	// Returns false if the queue of the source is full, the byte or event is not taken then and
+	// should be written again after poll().
+	bool write(uint8_t source, uint8_t byte);
+	bool writeEvent(uint8_t source, const midi_event_t &ev);
+
+	bool full(uint8_t source) const;
+
+	// Drops the queued events and the partial message of the source, like when it gets
+	// disconnected. If the source was sending SysEx, it is terminated with 0xF7.
+	void reset(uint8_t source);
+
+	// Sends queued events to the port, as many as it takes without waiting.
+	void poll();
+
+private:
+	enum { NONE = 0xff };
+
+	struct source_t
+	{
+		MidiToUsb m_serializer;
+		TFifo<midi_event_t, uint8_t, Q + 1> m_events;
+	};
+
+	static bool isRealTime(const midi_event_t &ev);
+	static bool isSysExEnd(const midi_event_t &ev);
+
+	void terminateSysEx();
+
+	USBMIDIPort &m_port;
+	source_t m_sources[N];
+	Scheduling m_scheduling;
+
+	// Source to pick first in round robin order.
+	uint8_t m_next;
+
+	// Source in the middle of sending SysEx, or NONE.
+	uint8_t m_locked;
+};
+
+template <const uint8_t N, const uint8_t Q>
+inline TMidiMerger<N, Q>::TMidiMerger(USBMIDIPort &port, Scheduling scheduling)
+	:m_port(port)
+	,m_scheduling(scheduling)
+	,m_next(0)
+	,m_locked(NONE)
+{
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline void TMidiMerger<N, Q>::setScheduling(Scheduling scheduling)
+{
+	m_scheduling = scheduling;
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline bool TMidiMerger<N, Q>::isRealTime(const midi_event_t &ev)
+{
+	return (ev.m_event & 0x0f) == 0x0f && midi_is_real_time(ev.m_data[0]);
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline bool TMidiMerger<N, Q>::isSysExEnd(const midi_event_t &ev)
+{
+	switch (ev.m_event & 0x0f)
+	{
+	case 0x5:
+		return ev.m_data[0] == 0xf7;
+	case 0x6:
+	case 0x7:
+		return true;
+	default:
+		return false;
+	}
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline void TMidiMerger<N, Q>::terminateSysEx()
+{
+	midi_event_t ev;
+	ev.m_event = 0x05;
+	ev.m_data[0] = 0xf7;
+	ev.m_data[1] = 0;
+	ev.m_data[2] = 0;
+	m_port.writeEvent(ev);
+	m_locked = NONE;
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline bool TMidiMerger<N, Q>::write(uint8_t source, uint8_t byte)
+{
+	source_t &s = m_sources[source];
+
+	// Real-Time bytes never complete a queued message, so they may pass a full queue.
+	if (s.m_events.full() && !midi_is_real_time(byte))
+		return false;
+
+	midi_event_t ev;
+	if (!s.m_serializer.process(byte, ev))
+		return true;
+
+	if (isRealTime(ev))
+		m_port.writeEvent(ev);
+	else s.m_events.push(ev);
+
+	return true;
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline bool TMidiMerger<N, Q>::writeEvent(uint8_t source, const midi_event_t &ev)
+{
+	if (isRealTime(ev))
+	{
+		m_port.writeEvent(ev);
+		return true;
+	}
+
+	source_t &s = m_sources[source];
+	if (s.m_events.full())
+		return false;
+
+	s.m_events.push(ev);
+	return true;
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline bool TMidiMerger<N, Q>::full(uint8_t source) const
+{
+	return m_sources[source].m_events.full();
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline void TMidiMerger<N, Q>::reset(uint8_t source)
+{
+	source_t &s = m_sources[source];
+
+	s.m_serializer.reset();
+
+	midi_event_t ev;
+	while (s.m_events.pop(ev))
+	{
+	}
+
+	if (m_locked == source)
+		terminateSysEx();
+}
+
+template <const uint8_t N, const uint8_t Q>
+inline void TMidiMerger<N, Q>::poll()
+{
+	int space = m_port.availableEventsForWrite();
+	while (space > 0)
+	{
+		uint8_t source = m_locked;
+
+		if (source == NONE)
+		{
+			for (uint8_t i=0; i<N; ++i)
+			{
+				uint8_t candidate = m_scheduling == PRIORITY ? i : (m_next + i) % N;
+				if (!m_sources[candidate].m_events.empty())
+				{
+					source = candidate;
+					break;
+				}
+			}
+
+			if (source == NONE)
+				return;
+
+			m_next = (source + 1) % N;
+		}
+
+		midi_event_t ev;
+		if (!m_sources[source].m_events.peek(ev))
+			return;
+
+		// The serializer drops SysEx interrupted by another message or restarted by another 0xF0,
+		// it gets closed for the host before the message is sent.
+		if (m_locked == source && (midi_is_sysex_start(ev.m_data[0]) || ((ev.m_event & 0x0f) != 0x04 && !isSysExEnd(ev))))
+		{
+			terminateSysEx();
+			--space;
+			continue;
+		}
+
+		m_sources[source].m_events.advance();
+		m_locked = (ev.m_event & 0x0f) == 0x04 ? source : NONE;
+
+		m_port.writeEvent(ev);
+		--space;
+	}
+}
+
+#endif // MIDI_MERGER_H
@@ -1,4 +1,4 @@
-/* 
+/*
  * Copyright (C) 2015-2018 UAB Vilniaus Blokas
  * All rights reserved.
  *
@@ -11,9 +11,63 @@
 
 #include <stdint.h>
 
+#ifdef __AVR__
+#	include <avr/pgmspace.h>
+#	define MIDI_TABLE_READ(p) pgm_read_byte(p)
+#else
+#	define MIDI_TABLE_READ(p) (*(p))
+#endif
+
+// Status byte info, as stored in midi_status_table:
+// bits 0-3 - USB MIDI Code Index Number, bits 4-5 - count of data bytes, bits 6-7 - message class.
+#define MIDI_CLASS_CHANNEL       0x00
+#define MIDI_CLASS_SYSTEM_COMMON 0x40
+#define MIDI_CLASS_SYSEX         0x80
+#define MIDI_CLASS_REAL_TIME     0xc0
+#define MIDI_CLASS_MASK          0xc0
+
+#define MIDI_STATUS_INFO(cls, length, cin) ((cls) | ((length) << 4) | (cin))
+
+// Info of all defined Real-Time status bytes. 0xf9 and 0xfd are undefined and have CIN 0.
+#define MIDI_STATUS_REAL_TIME MIDI_STATUS_INFO(MIDI_CLASS_REAL_TIME, 0, 0xf)
+
+// Info of 0xf4 - 0xf6, sent as CIN 0x5.
+#define MIDI_STATUS_SINGLE_BYTE_SYSTEM_COMMON MIDI_STATUS_INFO(MIDI_CLASS_SYSTEM_COMMON, 0, 0x5)
+
+// Indexed by status byte & 0x7f. Lives in PROGMEM on AVR.
+extern const uint8_t midi_status_table[128];
+
+// Count of MIDI bytes carried by a USB MIDI event, indexed by CIN. Lives in PROGMEM on AVR.
+extern const uint8_t midi_cin_length_table[16];
+
+inline uint8_t midi_status_info(uint8_t status)
+{
+	return MIDI_TABLE_READ(&midi_status_table[status & 0x7f]);
+}
+
+inline uint8_t midi_info_class(uint8_t info)
+{
+	return info & MIDI_CLASS_MASK;
+}
+
+inline uint8_t midi_info_data_length(uint8_t info)
+{
+	return (info >> 4) & 0x03;
+}
+
+inline uint8_t midi_info_cin(uint8_t info)
+{
+	return info & 0x0f;
+}
+
+inline uint8_t midi_cin_length(uint8_t cin)
+{
+	return MIDI_TABLE_READ(&midi_cin_length_table[cin & 0x0f]);
+}
+
 inline bool midi_is_real_time(uint8_t byte)
 {
-	return byte == 0xf8 || (byte >= 0xfa && byte != 0xfd);
+	return (byte & 0x80) && midi_status_info(byte) == MIDI_STATUS_REAL_TIME;
 }
 
 inline bool midi_is_sysex_start(uint8_t byte)
@@ -28,7 +82,7 @@ inline bool midi_is_sysex_end(uint8_t byte)
 
 inline bool midi_is_single_byte_system_common(uint8_t byte)
 {
-	return byte >= 0xf4 && byte <= 0xf6;
+	return (byte & 0x80) && midi_status_info(byte) == MIDI_STATUS_SINGLE_BYTE_SYSTEM_COMMON;
 }
 
 #endif // MIDI_MESSAGES_H
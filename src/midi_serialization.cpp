@@ -9,34 +9,48 @@
 #include "midi_serialization.h"
 #include "midi_messages.h"
 
+#ifdef __AVR__
+#	define MIDI_TABLE const PROGMEM
+#else
+#	define MIDI_TABLE constexpr
+#endif
+
+static constexpr uint8_t midi_classify_status(unsigned status)
+{
+	return
+		status < 0xf0 ? MIDI_STATUS_INFO(MIDI_CLASS_CHANNEL, (status & 0xe0) == 0xc0 ? 1 : 2, status >> 4) :
+		status == 0xf0 ? MIDI_STATUS_INFO(MIDI_CLASS_SYSEX, 0, 0x4) :
+		status == 0xf7 ? MIDI_STATUS_INFO(MIDI_CLASS_SYSEX, 0, 0x5) :
+		status == 0xf1 || status == 0xf3 ? MIDI_STATUS_INFO(MIDI_CLASS_SYSTEM_COMMON, 1, 0x2) : // MTC, Song Select
+		status == 0xf2 ? MIDI_STATUS_INFO(MIDI_CLASS_SYSTEM_COMMON, 2, 0x3) : // Song Position Pointer
+		status <= 0xf6 ? MIDI_STATUS_SINGLE_BYTE_SYSTEM_COMMON :
+		status == 0xf9 || status == 0xfd ? MIDI_STATUS_INFO(MIDI_CLASS_REAL_TIME, 0, 0x0) :
+		MIDI_STATUS_REAL_TIME;
+}
+
+#define MIDI_CLASSIFY_4(s) \
+	midi_classify_status(s), midi_classify_status((s)+1), midi_classify_status((s)+2), midi_classify_status((s)+3)
+#define MIDI_CLASSIFY_16(s) \
+	MIDI_CLASSIFY_4(s), MIDI_CLASSIFY_4((s)+4), MIDI_CLASSIFY_4((s)+8), MIDI_CLASSIFY_4((s)+12)
+
+MIDI_TABLE uint8_t midi_status_table[128] =
+{
+	MIDI_CLASSIFY_16(0x80), MIDI_CLASSIFY_16(0x90), MIDI_CLASSIFY_16(0xa0), MIDI_CLASSIFY_16(0xb0),
+	MIDI_CLASSIFY_16(0xc0), MIDI_CLASSIFY_16(0xd0), MIDI_CLASSIFY_16(0xe0), MIDI_CLASSIFY_16(0xf0),
+};
+
+// http://www.usb.org/developers/docs/devclass_docs/midi10.pdf, page 16
+MIDI_TABLE uint8_t midi_cin_length_table[16] =
+{
+	0, 0, // Unhandled 0x0 and 0x1 ("reserved for future")
+	2, 3, 3, 1, 2, 3,
+	3, 3, 3, 3, 2, 2, 3,
+	1,
+};
+
 extern "C" unsigned midi_get_data_length(midi_event_t ev)
 {
-	// http://www.usb.org/developers/docs/devclass_docs/midi10.pdf, page 16
-	switch (ev.m_event & 0x0f)
-	{
-	case 0x5:
-	case 0xF:
-		// 1 byte message
-		return 1;
-	case 0x2:
-	case 0x6:
-	case 0xC:
-	case 0xD:
-		// 2 byte message
-		return 2;
-	case 0x3:
-	case 0x4:
-	case 0x7:
-	case 0x8:
-	case 0x9:
-	case 0xA:
-	case 0xB:
-	case 0xE:
-		// 3 byte message
-		return 3;
-	default: // Unhandled 0x0 and 0x1 ("reserved for future")
-		return 0;
-	}
+	return midi_cin_length(ev.m_event);
 }
 
 MidiToUsb::MidiToUsb()
@@ -76,61 +90,73 @@ int MidiToUsb::getCable() const
 	return m_cable >> 4;
 }
 
-bool MidiToUsb::process(uint8_t byte, midi_event_t &out)
+inline bool MidiToUsb::step(uint8_t byte, midi_event_t &out)
 {
 	if (byte & 0x80) // Status byte received.
 	{
-		if (midi_is_real_time(byte))
+		uint8_t info = midi_status_info(byte);
+
+		switch (midi_info_class(info))
 		{
+		case MIDI_CLASS_REAL_TIME:
+			// Undefined 0xf9 and 0xfd are dropped without affecting the state.
+			if (midi_info_cin(info) == 0)
+				return false;
+
 			out.m_event = m_cable | 0x0f;
 			out.m_data[0] = byte;
 			out.m_data[1] = 0;
 			out.m_data[2] = 0;
-			//m_counter = 0;
 			return true;
-		}
-		else if (midi_is_single_byte_system_common(byte))
-		{
-			out.m_event = m_cable | 0x05;
-			out.m_data[0] = byte;
-			out.m_data[1] = 0;
-			out.m_data[2] = 0;
-			m_counter = 0;
-			return true;
-		}
-		else if (midi_is_sysex_start(byte))
-		{
-			m_sysex = true;
-			m_data[0] = byte;
-			m_counter = 1;
-			return false;
-		}
-		else if (midi_is_sysex_end(byte))
-		{
-			m_data[m_counter++] = byte;
-			out.m_event = m_cable | (0x04 + m_counter);
-			unsigned i=0;
-			for (; i<m_counter; ++i)
-				out.m_data[i] = m_data[i];
-			for (; i<sizeof(m_data); ++i)
-				out.m_data[i] = 0x00;
+		case MIDI_CLASS_SYSEX:
+			if (midi_is_sysex_start(byte))
+			{
+				m_status = 0;
+				m_sysex = true;
+				m_data[0] = byte;
+				m_counter = 1;
+				return false;
+			}
+			else
+			{
+				if (!m_sysex)
+					m_counter = 0;
+
+				m_data[m_counter++] = byte;
+				out.m_event = m_cable | (0x04 + m_counter);
+				unsigned i=0;
+				for (; i<m_counter; ++i)
+					out.m_data[i] = m_data[i];
+				for (; i<sizeof(m_data); ++i)
+					out.m_data[i] = 0x00;
+				m_sysex = false;
+				m_counter = 0;
+				return true;
+			}
+		default:
 			m_sysex = false;
 			m_counter = 0;
-			return true;
-		}
-		else
-		{
+
+			if (midi_info_data_length(info) == 0)
+			{
+				// Single byte System Common, also cancels Running Status.
+				out.m_event = m_cable | midi_info_cin(info);
+				out.m_data[0] = byte;
+				out.m_data[1] = 0;
+				out.m_data[2] = 0;
+				m_status = 0;
+				return true;
+			}
+
 			m_status = byte;
-			m_counter = 0;
 			return false;
 		}
 	}
 	else // Data byte received.
 	{
-		m_data[m_counter++] = byte;
-
 		if (m_sysex)
 		{
+			m_data[m_counter++] = byte;
 			if (m_counter == 3)
 			{
 				out.m_event = m_cable | 0x04;
@@ -143,101 +169,121 @@ bool MidiToUsb::process(uint8_t byte, midi_event_t &out)
 			return false;
 		}
 
-		switch (m_status & 0xf0)
-		{
-		case 0xf0:
-			switch (m_status & 0x0f)
-			{
-			case 0x1: // MTC
-			case 0x3: // Song Select
-				out.m_event = m_cable | 0x02;
-				out.m_data[0] = m_status;
-				out.m_data[1] = m_data[0];
-				out.m_data[2] = 0x00;
-				m_counter = 0;
-				return true;
-			case 0x2: // Song Position Pointer
-				if (m_counter == 2)
-				{
-					out.m_event = m_cable | 0x03;
-					out.m_data[0] = m_status;
-					out.m_data[1] = m_data[0];
-					out.m_data[2] = m_data[1];
-					m_counter = 0;
-					return true;
-				}
-				break;
-			}
-			break;
-		case 0x80:
-		case 0x90:
-		case 0xA0:
-		case 0xB0:
-		case 0xE0:
-			if (m_counter == 2)
-			{
-				out.m_event = m_cable | (m_status >> 4);
-				out.m_data[0] = m_status;
-				out.m_data[1] = m_data[0];
-				out.m_data[2] = m_data[1];
-				m_counter = 0;
-				return true;
-			}
-			break;
-		case 0xC0:
-		case 0xD0:
-			if (m_counter == 1)
-			{
-				out.m_event = m_cable | (m_status >> 4);
-				out.m_data[0] = m_status;
-				out.m_data[1] = m_data[0];
-				out.m_data[2] = 0x00;
-				m_counter = 0;
-				return true;
-			}
-			break;
-		case 0x00:
-			m_counter = 0;
+		// Data without a preceding status byte gets dropped.
+		if (m_status == 0)
+			return false;
+
+		m_data[m_counter++] = byte;
+
+		uint8_t info = midi_status_info(m_status);
+		if (m_counter < midi_info_data_length(info))
 			return false;
+
+		out.m_event = m_cable | midi_info_cin(info);
+		out.m_data[0] = m_status;
+		out.m_data[1] = m_data[0];
+		out.m_data[2] = m_counter == 2 ? m_data[1] : 0x00;
+		m_counter = 0;
+
+		// Running Status applies to Channel messages only.
+		if (midi_info_class(info) != MIDI_CLASS_CHANNEL)
+			m_status = 0;
+
+		return true;
+	}
+}
+
+bool MidiToUsb::process(uint8_t byte, midi_event_t &out)
+{
+	return step(byte, out);
+}
+
+size_t MidiToUsb::processBuffer(const uint8_t *in, size_t n, midi_event_t *out, size_t cap, size_t &consumed)
+{
+	// Run on a local copy of the state, so it can stay in registers instead of
+	// being reloaded through 'this' after every store to out.
+	MidiToUsb state(*this);
+
+	size_t i = 0;
+	size_t count = 0;
+	while (i < n && count < cap)
+	{
+		// Inside SysEx, whole triples of data bytes are packed straight into CIN 0x4 events.
+		if (state.m_sysex && state.m_counter == 0 && n - i >= 3 && ((in[i] | in[i+1] | in[i+2]) & 0x80) == 0)
+		{
+			midi_event_t &ev = out[count++];
+			ev.m_event = state.m_cable | 0x04;
+			ev.m_data[0] = in[i];
+			ev.m_data[1] = in[i+1];
+			ev.m_data[2] = in[i+2];
+			i += 3;
+			continue;
 		}
+
+		if (state.step(in[i++], out[count]))
+			++count;
 	}
 
-	return false;
+	*this = state;
+	consumed = i;
+	return count;
 }
 
 unsigned UsbToMidi::process(midi_event_t in, uint8_t out[3])
 {
-	switch (in.m_event & 0x0f)
-	{
-	case 0x5:
-	case 0xF:
-		// 1 byte message
-		out[0] = in.m_data[0];
-		return 1;
-	case 0x2:
-	case 0x6:
-	case 0xC:
-	case 0xD:
-		// 2 byte message
-		out[0] = in.m_data[0];
-		out[1] = in.m_data[1];
-		return 2;
-	case 0x3:
-	case 0x4:
-	case 0x7:
-	case 0x8:
-	case 0x9:
-	case 0xA:
-	case 0xB:
-	case 0xE:
-		// 3 byte message
-		out[0] = in.m_data[0];
-		out[1] = in.m_data[1];
-		out[2] = in.m_data[2];
-		return 3;
-	default: // unhandled 0x0 and 0x1 ("reserved for future")
+	// Copying all 3 bytes is cheaper than branching on the length.
+	out[0] = in.m_data[0];
+	out[1] = in.m_data[1];
+	out[2] = in.m_data[2];
+	return midi_cin_length(in.m_event);
+}
+
+UsbToMidiRunningStatus::UsbToMidiRunningStatus()
+	:m_status(0)
+	,m_refreshInterval(16)
+	,m_count(0)
+{
+}
+
+void UsbToMidiRunningStatus::reset()
+{
+	m_status = 0;
+}
+
+void UsbToMidiRunningStatus::setRefreshInterval(uint8_t messages)
+{
+	m_refreshInterval = messages;
+	reset();
+}
+
+unsigned UsbToMidiRunningStatus::process(midi_event_t in, uint8_t out[3])
+{
+	unsigned n = UsbToMidi::process(in, out);
+	if (n == 0)
 		return 0;
+
+	uint8_t status = out[0];
+
+	if (status >= 0xf8)
+		return n;
+
+	// SysEx data, System Common and anything malformed.
+	if (status < 0x80 || status >= 0xf0 || n == 1)
+	{
+		m_status = 0;
+		return n;
+	}
+
+	if (status == m_status && (m_refreshInterval == 0 || ++m_count < m_refreshInterval))
+	{
+		out[0] = out[1];
+		out[1] = out[2];
+		return n - 1;
 	}
+
+	m_status = status;
+	m_count = 0;
+	return n;
 }
 
 extern "C" unsigned usb_to_midi(struct midi_event_t in, uint8_t out[3])
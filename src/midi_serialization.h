@@ -9,6 +9,7 @@
 #ifndef MIDI_SERIALIZATION_H
 #define MIDI_SERIALIZATION_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef unsigned char uint8_t;
@@ -34,7 +35,13 @@ public:
 
 	bool process(uint8_t byte, midi_event_t &out);
 
+	// Serializes up to n bytes from in, stopping early once cap events were produced.
+	// Returns the number of events written to out, consumed is set to the number of bytes used up.
+	size_t processBuffer(const uint8_t *in, size_t n, midi_event_t *out, size_t cap, size_t &consumed);
+
 private:
+	inline bool step(uint8_t byte, midi_event_t &out);
+
 	int m_cable;
 
 	uint8_t m_status;
@@ -48,6 +55,53 @@ class UsbToMidi
 {
 public:
 	static unsigned process(midi_event_t in, uint8_t out[3]);
+
+	// Splits a raw USB MIDI packet of len bytes into its events, passing each to sink(ev). Events
+	// never span USB packets, so the trailing bytes of a packet which is not a multiple of 4 long
+	// are ignored. Returns the number of events passed on.
+	template <typename Sink>
+	static uint8_t processPacket(const uint8_t *packet, uint8_t len, Sink &sink);
+};
+
+template <typename Sink>
+inline uint8_t UsbToMidi::processPacket(const uint8_t *packet, uint8_t len, Sink &sink)
+{
+	uint8_t count = 0;
+	for (uint8_t i=0; i+sizeof(midi_event_t) <= len; i += sizeof(midi_event_t))
+	{
+		midi_event_t ev;
+		ev.m_event = packet[i];
+		ev.m_data[0] = packet[i+1];
+		ev.m_data[1] = packet[i+2];
+		ev.m_data[2] = packet[i+3];
+		sink(ev);
+		++count;
+	}
+	return count;
+}
+
+// Stateful version of UsbToMidi for serial MIDI links, leaves out the status byte of a Channel
+// message if it's the same as the previous one (running status). System Common messages and
+// SysEx cancel the running status, Real-Time messages leave it as is. The status byte is sent
+// again at least once every refresh interval messages, so a receiver connected in the middle
+// of a stream picks it up.
+class UsbToMidiRunningStatus
+{
+public:
+	UsbToMidiRunningStatus();
+
+	// Makes the next Channel message include its status byte.
+	void reset();
+
+	// Interval in messages, 0 never repeats an unchanged status, 1 disables running status.
+	void setRefreshInterval(uint8_t messages);
+
+	unsigned process(midi_event_t in, uint8_t out[3]);
+
+private:
+	uint8_t m_status;
+	uint8_t m_refreshInterval;
+	uint8_t m_count;
 };
 
 #endif // __cplusplus
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include "midi_sysex_receiver.h"
+#include "midi_messages.h"
+
+MidiSysExReceiver::MidiSysExReceiver(uint8_t *buffer, size_t size, callback_t callback)
+	:m_buffer(buffer)
+	,m_size(size < MIN_BUFFER_SIZE ? 0 : size)
+	,m_length(0)
+	,m_callback(callback)
+	,m_filterLength(0)
+	,m_position(0)
+	,m_active(false)
+	,m_skipping(false)
+{
+}
+
+void MidiSysExReceiver::setManufacturerFilter(const uint8_t *id, uint8_t length)
+{
+	if (length > sizeof(m_filter))
+		length = sizeof(m_filter);
+
+	for (uint8_t i=0; i<length; ++i)
+		m_filter[i] = id[i];
+
+	m_filterLength = length;
+}
+
+bool MidiSysExReceiver::process(const midi_event_t &ev)
+{
+	if (m_size == 0)
+		return false;
+
+	uint8_t cin = ev.m_event & 0x0f;
+	if (cin < 0x4 || cin > 0x7)
+		return false;
+
+	// CIN 0x5 is also used for single byte System Common messages.
+	if (cin == 0x5 && !midi_is_sysex_end(ev.m_data[0]))
+		return false;
+
+	uint8_t n = midi_cin_length(cin);
+	for (uint8_t i=0; i<n; ++i)
+		receive(ev.m_data[i]);
+
+	return true;
+}
+
+void MidiSysExReceiver::reset()
+{
+	m_active = false;
+	m_length = 0;
+}
+
+void MidiSysExReceiver::receive(uint8_t byte)
+{
+	if (midi_is_sysex_start(byte))
+	{
+		// Restarts reception, dropping any unfinished message.
+		m_active = true;
+		m_skipping = false;
+		m_length = 0;
+		m_position = 0;
+	}
+	else if (!m_active)
+	{
+		return;
+	}
+
+	if (!m_skipping)
+	{
+		if (m_position > 0 && m_position <= m_filterLength && byte != m_filter[m_position - 1])
+		{
+			m_skipping = true;
+		}
+		else
+		{
+			if (m_length == m_size)
+			{
+				m_callback(m_buffer, m_length, false);
+				m_length = 0;
+			}
+
+			m_buffer[m_length++] = byte;
+		}
+	}
+
+	if (m_position <= sizeof(m_filter))
+		++m_position;
+
+	if (midi_is_sysex_end(byte))
+	{
+		if (!m_skipping)
+			m_callback(m_buffer, m_length, true);
+
+		reset();
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef MIDI_SYSEX_RECEIVER_H
+#define MIDI_SYSEX_RECEIVER_H
+
+#include <stddef.h>
+
+#include "midi_serialization.h"
+
+// Assembles incoming SysEx events (CIN 0x4 - 0x7) into a user supplied buffer. Set on a port
+// using USBMIDIPort::setSysExReceiver, SysEx of that cable then bypasses the input queue,
+// everything else keeps going through it.
+class MidiSysExReceiver
+{
+public:
+	// Called with received message data, starting with 0xF0. If the buffer fills up before the
+	// message ends, it gets called with complete set to false, and the rest of the message is
+	// collected from the beginning of the buffer again. Called from within USBMIDI's poll or read
+	// functions.
+	typedef void (*callback_t)(const uint8_t *data, size_t length, bool complete);
+
+	// The buffer must be at least 4 bytes, so the manufacturer ID is known before it fills up.
+	// With a smaller buffer the receiver stays disabled and SysEx goes through the input queue.
+	enum { MIN_BUFFER_SIZE = 4 };
+	MidiSysExReceiver(uint8_t *buffer, size_t size, callback_t callback);
+
+	// Only messages with the given manufacturer ID are received, the rest are dropped. IDs are 1
+	// byte long, or 3 bytes starting with 0x00. A length of 0 receives all messages.
+	void setManufacturerFilter(const uint8_t *id, uint8_t length);
+
+	// Returns false if the event is not part of SysEx or the receiver is disabled, so it should
+	// be handled as usual.
+	bool process(const midi_event_t &ev);
+
+	// Drops the message being received.
+	void reset();
+
+private:
+	void receive(uint8_t byte);
+
+	uint8_t *m_buffer;
+	size_t m_size;
+	size_t m_length;
+	callback_t m_callback;
+
+	uint8_t m_filter[3];
+	uint8_t m_filterLength;
+
+	// Count of bytes of the current message so far, stops counting past the manufacturer ID.
+	uint8_t m_position;
+
+	bool m_active;
+	bool m_skipping;
+};
+
+#endif // MIDI_SYSEX_RECEIVER_H
@@ -100,11 +100,16 @@ section at the end of this file).
  * default control endpoint 0 and an interrupt-in endpoint (any other endpoint
  * number).
  */
-#define USB_CFG_HAVE_INTRIN_ENDPOINT3   0
+#ifndef USBMIDI_VUSB_DUAL_IN
+#define USBMIDI_VUSB_DUAL_IN            0
+#endif
+#define USB_CFG_HAVE_INTRIN_ENDPOINT3   USBMIDI_VUSB_DUAL_IN
 /* Define this to 1 if you want to compile a version with three endpoints: The
  * default control endpoint 0, an interrupt-in endpoint 3 (or the number
  * configured below) and a catch-all default interrupt-in endpoint as above.
  * You must also define USB_CFG_HAVE_INTRIN_ENDPOINT to 1 for this feature.
+ * USBMIDI uses endpoint 3 as a second MIDI IN endpoint if USBMIDI_VUSB_DUAL_IN
+ * is defined to 1.
  */
 #define USB_CFG_EP3_NUMBER              3
 /* If the so-called endpoint 3 is used, it can now be configured to any other
@@ -130,10 +135,23 @@ section at the end of this file).
  * (e.g. HID), but never want to send any data. This option saves a couple
  * of bytes in flash memory and the transmit buffers in RAM.
  */
-#define USB_CFG_INTR_POLL_INTERVAL      10
+#ifndef USBMIDI_VUSB_POLL_INTERVAL
+#   if defined(USBMIDI_LOW_LATENCY) && USBMIDI_LOW_LATENCY
+#       define USBMIDI_VUSB_POLL_INTERVAL   1
+#   else
+#       define USBMIDI_VUSB_POLL_INTERVAL   10
+#   endif
+#endif
+#define USB_CFG_INTR_POLL_INTERVAL      USBMIDI_VUSB_POLL_INTERVAL
 /* If you compile a version with endpoint 1 (interrupt-in), this is the poll
  * interval. The value is in milliseconds and must not be less than 10 ms for
  * low speed devices.
+ * USBMIDI uses it as bInterval of both MIDI endpoints. Up to 2 events are
+ * transferred per interval in each direction, so the default of 10 ms
+ * limits the throughput to 200 events/s. USBMIDI_LOW_LATENCY selects 1 ms,
+ * which is below the spec minimum for low speed devices, so some hosts may
+ * round it up (Windows uses 8 ms). Set USBMIDI_VUSB_POLL_INTERVAL for any
+ * other value.
  */
 #define USB_CFG_IS_SELF_POWERED         0
 /* Define this to 1 if the device has its own power supply. Set it to 0 if the
@@ -161,20 +179,34 @@ section at the end of this file).
  * interrupt/bulk data sent to any endpoint other than 0. The endpoint number
  * can be found in 'usbRxToken'.
  */
-#define USB_CFG_HAVE_FLOWCONTROL        0
+#ifndef USBMIDI_VUSB_FLOW_CONTROL
+#define USBMIDI_VUSB_FLOW_CONTROL       1
+#endif
+#define USB_CFG_HAVE_FLOWCONTROL        USBMIDI_VUSB_FLOW_CONTROL
 /* Define this to 1 if you want flowcontrol over USB data. See the definition
  * of the macros usbDisableAllRequests() and usbEnableAllRequests() in
  * usbdrv.h.
+ * USBMIDI uses it to NAK incoming MIDI data while the input queue of a cable
+ * the sketch reads from is close to full, define USBMIDI_VUSB_FLOW_CONTROL to
+ * 0 to drop such data instead.
  */
 #define USB_CFG_DRIVER_FLASH_PAGE       0
 /* If the device has more than 64 kBytes of flash, define this to the 64 k page
  * where the driver's constants (descriptors) are located. Or in other words:
  * Define this to 1 for boot loaders on the ATMega128.
  */
-#define USB_CFG_LONG_TRANSFERS          0
+#ifndef USB_CFG_LONG_TRANSFERS
+#   if defined(USBMIDI_CABLE_COUNT) && USBMIDI_CABLE_COUNT > 5
+#       define USB_CFG_LONG_TRANSFERS   1
+#   else
+#       define USB_CFG_LONG_TRANSFERS   0
+#   endif
+#endif
 /* Define this to 1 if you want to send/receive blocks of more than 254 bytes
  * in a single control-in or control-out transfer. Note that the capability
  * for long transfers increases the driver size.
+ * USBMIDI enables it by default for more than 5 cables, as the configuration
+ * descriptor grows past 255 bytes then.
  */
 /* #define USB_RX_USER_HOOK(data, len)     if(usbRxToken == (uchar)USBPID_SETUP) blinkLED(); */
 /* This macro is a hook if you want to do unconventional things. If it is
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include "usbmidi.h"
+#include "midi_messages.h"
+
+USBMIDIPort::USBMIDIPort(uint8_t cable)
+	:m_cable(cable)
+{
+}
+
+uint8_t USBMIDIPort::getCable() const
+{
+	return m_cable;
+}
+
+size_t USBMIDIPort::writeSysEx(const uint8_t *data, size_t len)
+{
+	if (len == 0 || !midi_is_sysex_start(data[0]))
+		beginSysEx();
+
+	write(data, len);
+
+	if (len == 0 || !midi_is_sysex_end(data[len - 1]))
+		endSysEx();
+
+	return len;
+}
+
+void USBMIDIPort::beginSysEx()
+{
+	write((uint8_t)0xf0);
+}
+
+size_t USBMIDIPort::appendSysEx(const uint8_t *data, size_t len)
+{
+	// The serializer packs runs of SysEx data straight into events.
+	return write(data, len);
+}
+
+void USBMIDIPort::endSysEx()
+{
+	write((uint8_t)0xf7);
+}
+
+#if USBMIDI_CABLE_COUNT > 1
+// Ports of the cables following cable 0, numbered in the order of construction.
+class USBMIDICablePort : public USBMIDIPort
+{
+public:
+	USBMIDICablePort()
+		:USBMIDIPort(s_next++)
+	{
+	}
+
+private:
+	static uint8_t s_next;
+};
+
+uint8_t USBMIDICablePort::s_next = 1;
+#endif
+
+USBMIDIPort *USBMIDI_::port(uint8_t cable)
+{
+	if (cable == 0)
+		return this;
+
+#if USBMIDI_CABLE_COUNT > 1
+	static USBMIDICablePort ports[USBMIDI_CABLE_COUNT - 1];
+
+	if (cable < USBMIDI_CABLE_COUNT)
+		return &ports[cable - 1];
+#endif
+
+	return NULL;
+}
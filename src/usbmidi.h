@@ -15,10 +15,26 @@
 
 #include <Stream.h>
 
-class USBMIDI_ : public Stream
+#include "midi_serialization.h"
+#include "midi_sysex_receiver.h"
+
+// Count of virtual MIDI cables (ports) exposed by the device, 1 to 16. Must be a plain number,
+// as it is used for generating the descriptors.
+#ifndef USBMIDI_CABLE_COUNT
+#define USBMIDI_CABLE_COUNT 1
+#endif
+
+#if USBMIDI_CABLE_COUNT < 1 || USBMIDI_CABLE_COUNT > 16
+#	error USBMIDI_CABLE_COUNT must be in range of 1 to 16!
+#endif
+
+// Stream of a single virtual MIDI cable. Each cable has its own serializer and input queue.
+class USBMIDIPort : public Stream
 {
 public:
-	USBMIDI_();
+	explicit USBMIDIPort(uint8_t cable = 0);
+
+	uint8_t getCable() const;
 
 	// Stream interface.
 	virtual int available();
@@ -28,6 +44,61 @@ public:
 
 	// Print interface.
 	virtual size_t write(uint8_t c);
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+
+	// Event interface, working with whole USB MIDI events instead of bytes. It shares the queues
+	// with the Stream interface, so both can be used, though mixing them within a message is not
+	// supported. writeEvent replaces the cable number of the event with the one of the port.
+	int availableEvents();
+	bool readEvent(midi_event_t &ev);
+	bool peekEvent(midi_event_t &ev);
+	bool writeEvent(const midi_event_t &ev);
+
+	// Returns the count of events which can be written without waiting for the host to take
+	// earlier output, any of them may be a Real-Time one.
+	int availableEventsForWrite();
+
+	// SysEx transmission, data bytes are packed 3 per event. writeSysEx sends a whole message,
+	// the 0xF0 and 0xF7 framing bytes are added if data doesn't start or end with them. Long
+	// messages can be sent in parts, by calling appendSysEx with data bytes between beginSysEx
+	// and endSysEx. Real-Time messages may be written in between the parts.
+	size_t writeSysEx(const uint8_t *data, size_t len);
+	void beginSysEx();
+	size_t appendSysEx(const uint8_t *data, size_t len);
+	void endSysEx();
+
+	// Incoming SysEx of this cable is assembled by the given receiver instead of being queued,
+	// so messages of any length can be received without growing the input queue. NULL restores
+	// queueing them.
+	void setSysExReceiver(MidiSysExReceiver *receiver);
+
+	// Incoming Real-Time messages (clock, start, continue, stop, ...) of this cable are always
+	// read ahead of other queued input. With a callback set, they are handed to it as soon as
+	// they're received, from within poll() or the reading functions, instead of being queued.
+	// Outgoing ones are sent ahead of other queued output.
+	void setRealTimeCallback(void (*callback)(uint8_t byte));
+
+protected:
+	friend class USBMIDI_;
+
+	uint8_t m_cable;
+};
+
+class USBMIDI_ : public USBMIDIPort
+{
+public:
+	USBMIDI_();
+
+	// Returns the port of the given cable, USBMIDI itself being the port of cable 0, or NULL if
+	// the cable number is out of range.
+	USBMIDIPort *port(uint8_t cable);
+
+	// Unchecked version of port(), like with arrays the cable must be less than USBMIDI_CABLE_COUNT.
+	inline USBMIDIPort &operator[](uint8_t cable) { return *port(cable); }
+
+	// Returns the count of incoming events dropped due to full input queues.
+	unsigned int getOverflowCount() const;
 
 	// At the moment implemented for V-USB implementation only. USB_COUNT_SOF must be enabled.
 	void setSuspendResumeCallback(void (*callback)(bool suspended));
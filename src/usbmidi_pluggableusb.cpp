@@ -10,7 +10,8 @@
 
 #if defined(USBCON)
 
-#include "fifo.h"
+#include "midi_coalesce.h"
+#include "midi_in_fifo.h"
 
 #include <PluggableUSB.h>
 
@@ -43,29 +44,72 @@
 #define D_MIDI_JACK_EP(endpointAddress) \
 	0x09, 0x05, endpointAddress, 0x02, 0x40, 0x00, 0x00, 0x00, 0x00
 
-#define D_MIDI_JACK_EP_SPC(associatedJackId) \
-	0x05, 0x25, 0x01, 0x01, associatedJackId
+#define D_MIDI_JACK_EP_SPC(jackCount) \
+	0x04 + (jackCount), 0x25, 0x01, jackCount
+
+// Each cable has 4 jacks, numbered from 1.
+#define D_JACK_ID(cable, n) ((u8)(4 * (cable) + (n)))
+
+#define D_MIDI_CABLE_JACKS(cable) \
+	D_MIDI_IN_JACK(D_JACK_TYPE_EMBEDDED, D_JACK_ID(cable, 1)), \
+	D_MIDI_IN_JACK(D_JACK_TYPE_EXTERNAL, D_JACK_ID(cable, 2)), \
+	D_MIDI_OUT_JACK(D_JACK_TYPE_EMBEDDED, D_JACK_ID(cable, 3), D_JACK_ID(cable, 2), 0x01), \
+	D_MIDI_OUT_JACK(D_JACK_TYPE_EXTERNAL, D_JACK_ID(cable, 4), D_JACK_ID(cable, 1), 0x01)
+
+// Class-specific MS header, jacks and both endpoints with their class-specific descriptors.
+#define D_MIDI_STREAM_LENGTH(cableCount) (7 + 30 * (cableCount) + 2 * (9 + 4 + (cableCount)))
 
 #ifndef USBMIDI_IN_BUFFER_SIZE
 #define USBMIDI_IN_BUFFER_SIZE 64
 #endif
 
-typedef TFifo<uint8_t, uint8_t, USBMIDI_IN_BUFFER_SIZE> Fifo;
+// Outgoing events are collected into packets of up to 64 bytes, a packet gets sent once full, on
+// flush() or when its first event has been waiting for this many milliseconds. 0 sends every event
+// as soon as it's written.
+#ifndef USBMIDI_TX_LATENCY_MS
+#define USBMIDI_TX_LATENCY_MS 1
+#endif
+
+#define USBMIDI_TX_PACKET_EVENTS (USB_EP_SIZE / sizeof(midi_event_t))
+
+// When enabled, incoming data which doesn't fit into the input queues is left in the endpoint
+// bank, making the host retry until the sketch reads enough to make space for it, instead of
+// being dropped. As the cable of the events is not known before reading them, the least free
+// input queue limits all cables.
+#ifndef USBMIDI_LOSSLESS_RX
+#define USBMIDI_LOSSLESS_RX 0
+#endif
+
+// The buffer size is given in bytes, the queue stores 4 byte USB MIDI events. TFifo keeps one
+// slot free to tell a full queue from an empty one, so a whole packet fits in the default size.
+typedef TMidiInFifo<USBMIDI_IN_BUFFER_SIZE / sizeof(midi_event_t) + 1> Fifo;
 
 class UsbMidiModule : public PluggableUSBModule
 {
 public:
 	static void install();
 
-	inline static int available() { return getInstance()._available(); }
-	inline static int read() { return getInstance()._read(); }
-	inline static int peek() { return getInstance()._peek(); }
+	inline static int available(uint8_t cable) { return getInstance()._available(cable); }
+	inline static int read(uint8_t cable) { return getInstance()._read(cable); }
+	inline static int peek(uint8_t cable) { return getInstance()._peek(cable); }
 	inline static void flush() { return getInstance()._flush(); }
 
-	inline static size_t write(uint8_t c) { return getInstance()._write(c); }
+	inline static size_t write(uint8_t cable, uint8_t c) { return getInstance()._write(cable, c); }
+	inline static size_t write(uint8_t cable, const uint8_t *buffer, size_t size) { return getInstance()._write(cable, buffer, size); }
+
+	inline static int availableEvents(uint8_t cable) { return getInstance()._availableEvents(cable); }
+	inline static bool readEvent(uint8_t cable, midi_event_t &ev) { return getInstance()._readEvent(cable, ev); }
+	inline static bool peekEvent(uint8_t cable, midi_event_t &ev) { return getInstance()._peekEvent(cable, ev); }
+	inline static bool writeEvent(const midi_event_t &ev) { return getInstance()._writeEvent(ev); }
+	inline static int availableEventsForWrite() { return getInstance()._availableEventsForWrite(); }
 
 	inline static void poll() { return getInstance()._poll(); }
 
+	inline static void setSysExReceiver(uint8_t cable, MidiSysExReceiver *receiver) { getInstance().m_midiInFifo[cable].setSysExReceiver(receiver); }
+	inline static void setRealTimeCallback(uint8_t cable, void (*callback)(uint8_t byte)) { getInstance().m_midiInFifo[cable].setRealTimeCallback(callback); }
+
+	inline static unsigned int getOverflowCount() { return getInstance().m_overflowCount; }
+
 protected:
 	virtual bool setup(USBSetup& setup);
 	virtual int getInterface(uint8_t* interfaceCount);
@@ -76,22 +120,49 @@ private:
 
 	static UsbMidiModule &getInstance();
 
-	int _available();
-	int _read();
-	int _peek();
+	int _available(uint8_t cable);
+	int _read(uint8_t cable);
+	int _peek(uint8_t cable);
 	void _flush();
-	size_t _write(uint8_t c);
+	size_t _write(uint8_t cable, uint8_t c);
+	size_t _write(uint8_t cable, const uint8_t *buffer, size_t size);
+	int _availableEvents(uint8_t cable);
+	bool _readEvent(uint8_t cable, midi_event_t &ev);
+	bool _peekEvent(uint8_t cable, midi_event_t &ev);
+	bool _writeEvent(const midi_event_t &ev);
+	int _availableEventsForWrite();
 	void _poll();
 
+	static bool isRealTime(const midi_event_t &ev);
+
+	// Hands the events of a received packet over to receive().
+	struct Receiver
+	{
+		UsbMidiModule &m_module;
+		inline void operator()(const midi_event_t &ev) { m_module.receive(ev); }
+	};
+
+	void receive(const midi_event_t &ev);
+
+	void queueEvent(const midi_event_t &ev);
+	void sendPacket();
+	void checkLatency();
+
 	uint8_t getInEndpointId() const;
 	uint8_t getOutEndpointId() const;
 
 	inline uint8_t getInterfaceId() const;
 
 	static uint8_t s_endpointTypes[2];
-	MidiToUsb m_midiToUsb;
+	MidiToUsb m_midiToUsb[USBMIDI_CABLE_COUNT];
 
-	Fifo m_midiInFifo;
+	Fifo m_midiInFifo[USBMIDI_CABLE_COUNT];
+
+	unsigned int m_overflowCount;
+
+	midi_event_t m_txPacket[USBMIDI_TX_PACKET_EVENTS];
+	uint8_t m_txCount;
+	unsigned long m_txTime;
 };
 
 uint8_t UsbMidiModule::s_endpointTypes[2] =
@@ -114,23 +185,56 @@ int UsbMidiModule::getInterface(uint8_t *interfaceCount)
 {
 	*interfaceCount += 2;
 
-	u8 desc[] =
+	// Sent in parts, to avoid keeping the descriptors of all cables on the stack.
+	int sent = 0;
+	int res;
+
+	u8 header[] =
 	{
 		D_AUDIO_CONTROL_INTERFACE(pluggedInterface),
 		D_AUDIO_CONTROL_INTERFACE_SPC(0x03),
-		D_AUDIO_STREAM_INTERFACE(pluggedInterface + 1),
-		D_AUDIO_STREAM_INTERFACE_SPC(0x41),
-		D_MIDI_IN_JACK(D_JACK_TYPE_EMBEDDED, 0x01),
-		D_MIDI_IN_JACK(D_JACK_TYPE_EXTERNAL, 0x02),
-		D_MIDI_OUT_JACK(D_JACK_TYPE_EMBEDDED, 0x03, 0x02, 0x01),
-		D_MIDI_OUT_JACK(D_JACK_TYPE_EXTERNAL, 0x04, 0x01, 0x01),
-		D_MIDI_JACK_EP(D_ENDPOINT_OUT | getOutEndpointId()),
-		D_MIDI_JACK_EP_SPC(0x01),
-		D_MIDI_JACK_EP(D_ENDPOINT_IN | getInEndpointId()),
-		D_MIDI_JACK_EP_SPC(0x03),
+		D_AUDIO_STREAM_INTERFACE((u8)(pluggedInterface + 1)),
+		D_AUDIO_STREAM_INTERFACE_SPC(D_MIDI_STREAM_LENGTH(USBMIDI_CABLE_COUNT)),
 	};
 
-	return USB_SendControl(0, desc, sizeof(desc));
+	if ((res = USB_SendControl(0, header, sizeof(header))) < 0)
+		return res;
+	sent += res;
+
+	for (uint8_t i=0; i<USBMIDI_CABLE_COUNT; ++i)
+	{
+		u8 jacks[] = { D_MIDI_CABLE_JACKS(i) };
+
+		if ((res = USB_SendControl(0, jacks, sizeof(jacks))) < 0)
+			return res;
+		sent += res;
+	}
+
+	// The endpoints are associated with the embedded jacks of every cable.
+	for (uint8_t ep=0; ep<2; ++ep)
+	{
+		u8 endpoint[] =
+		{
+			D_MIDI_JACK_EP((u8)(ep == 0 ? D_ENDPOINT_OUT | getOutEndpointId() : D_ENDPOINT_IN | getInEndpointId())),
+			D_MIDI_JACK_EP_SPC(USBMIDI_CABLE_COUNT),
+		};
+
+		u8 jackIds[USBMIDI_CABLE_COUNT];
+		for (uint8_t i=0; i<USBMIDI_CABLE_COUNT; ++i)
+		{
+			jackIds[i] = D_JACK_ID(i, ep == 0 ? 1 : 3);
+		}
+
+		if ((res = USB_SendControl(0, endpoint, sizeof(endpoint))) < 0)
+			return res;
+		sent += res;
+
+		if ((res = USB_SendControl(0, jackIds, sizeof(jackIds))) < 0)
+			return res;
+		sent += res;
+	}
+
+	return sent;
 }
 
 int UsbMidiModule::getDescriptor(USBSetup &setup)
@@ -140,8 +244,14 @@ int UsbMidiModule::getDescriptor(USBSetup &setup)
 
 UsbMidiModule::UsbMidiModule()
 	:PluggableUSBModule(2, 2, s_endpointTypes)
-	,m_midiToUsb(0)
+	,m_overflowCount(0)
+	,m_txCount(0)
+	,m_txTime(0)
 {
+	for (uint8_t i=0; i<USBMIDI_CABLE_COUNT; ++i)
+	{
+		m_midiToUsb[i].setCable(i);
+	}
 }
 
 UsbMidiModule& UsbMidiModule::getInstance()
@@ -150,71 +260,208 @@ UsbMidiModule& UsbMidiModule::getInstance()
 	return instance;
 }
 
-int UsbMidiModule::_available()
+int UsbMidiModule::_available(uint8_t cable)
 {
 	_poll();
-	return !m_midiInFifo.empty();
+	return m_midiInFifo[cable].available();
 }
 
-int UsbMidiModule::_read()
+int UsbMidiModule::_read(uint8_t cable)
 {
 	_poll();
+	return m_midiInFifo[cable].read();
+}
 
-	u8 byte = 0;
-	m_midiInFifo.pop(byte);
+int UsbMidiModule::_peek(uint8_t cable)
+{
+	_poll();
+	return m_midiInFifo[cable].peek();
+}
 
-	return byte;
+void UsbMidiModule::_flush()
+{
+	sendPacket();
+	USB_Flush(getInEndpointId());
 }
 
-int UsbMidiModule::_peek()
+void UsbMidiModule::queueEvent(const midi_event_t &ev)
 {
-	_poll();
+#if USBMIDI_COALESCE
+	if (midi_coalesce(m_txPacket, m_txCount, ev))
+	{
+		checkLatency();
+		return;
+	}
+#endif
 
-	u8 byte = 0;
-	m_midiInFifo.peek(byte);
+	if (m_txCount == 0)
+		m_txTime = millis();
 
-	return byte;
+	m_txPacket[m_txCount++] = ev;
+
+	// Real-Time messages go out right away, with whatever was collected before them.
+	if (m_txCount == USBMIDI_TX_PACKET_EVENTS || isRealTime(ev))
+		sendPacket();
+	else checkLatency();
 }
 
-void UsbMidiModule::_flush()
+bool UsbMidiModule::isRealTime(const midi_event_t &ev)
 {
-	USB_Flush(getInEndpointId());
+	return (ev.m_event & 0x0f) == 0x0f && midi_is_real_time(ev.m_data[0]);
 }
 
-size_t UsbMidiModule::_write(uint8_t c)
+void UsbMidiModule::sendPacket()
+{
+	if (m_txCount == 0)
+		return;
+
+	USB_Send(getInEndpointId(), m_txPacket, m_txCount * sizeof(midi_event_t));
+
+	// The core hands the bank to the host by itself only once it's full.
+	if (m_txCount != USBMIDI_TX_PACKET_EVENTS)
+		USB_Flush(getInEndpointId());
+
+	m_txCount = 0;
+}
+
+void UsbMidiModule::checkLatency()
+{
+	if (m_txCount != 0 && millis() - m_txTime >= USBMIDI_TX_LATENCY_MS)
+		sendPacket();
+}
+
+size_t UsbMidiModule::_write(uint8_t cable, uint8_t c)
 {
 	midi_event_t midiEvent;
-	if (m_midiToUsb.process(c, midiEvent))
+	if (m_midiToUsb[cable].process(c, midiEvent))
 	{
-		USB_Send(getInEndpointId(), &midiEvent, sizeof(midiEvent));
+		queueEvent(midiEvent);
 	}
 
 	return 1;
 }
 
+size_t UsbMidiModule::_write(uint8_t cable, const uint8_t *buffer, size_t size)
+{
+	// Serialize the buffer straight into the packet being collected.
+	size_t remaining = size;
+	while (remaining)
+	{
+		if (m_txCount == 0)
+			m_txTime = millis();
+
+		size_t consumed;
+		uint8_t first = m_txCount;
+		m_txCount += m_midiToUsb[cable].processBuffer(buffer, remaining, &m_txPacket[m_txCount], USBMIDI_TX_PACKET_EVENTS - m_txCount, consumed);
+
+#if USBMIDI_COALESCE
+		// Merge the new events into the pending ones, closing up the gaps they leave.
+		uint8_t count = first;
+		for (uint8_t i=first; i<m_txCount; ++i)
+		{
+			if (!midi_coalesce(m_txPacket, count, m_txPacket[i]))
+				m_txPacket[count++] = m_txPacket[i];
+		}
+		m_txCount = count;
+#endif
+
+		bool realTime = false;
+		for (uint8_t i=first; i<m_txCount; ++i)
+			realTime |= isRealTime(m_txPacket[i]);
+
+		if (m_txCount == USBMIDI_TX_PACKET_EVENTS || realTime)
+			sendPacket();
+
+		buffer += consumed;
+		remaining -= consumed;
+	}
+
+	checkLatency();
+	return size;
+}
+
+int UsbMidiModule::_availableEvents(uint8_t cable)
+{
+	_poll();
+	return m_midiInFifo[cable].availableEvents();
+}
+
+bool UsbMidiModule::_readEvent(uint8_t cable, midi_event_t &ev)
+{
+	_poll();
+	return m_midiInFifo[cable].readEvent(ev);
+}
+
+bool UsbMidiModule::_peekEvent(uint8_t cable, midi_event_t &ev)
+{
+	_poll();
+	return m_midiInFifo[cable].peekEvent(ev);
+}
+
+bool UsbMidiModule::_writeEvent(const midi_event_t &ev)
+{
+	queueEvent(ev);
+	return true;
+}
+
+int UsbMidiModule::_availableEventsForWrite()
+{
+	// Completing the packet or a Real-Time event sends it, which waits while the endpoint
+	// still holds earlier data. Some cores report one byte less than the bank size as free.
+	if (USB_SendSpace(getInEndpointId()) < USB_EP_SIZE - 1)
+		return 0;
+
+	return USBMIDI_TX_PACKET_EVENTS - m_txCount;
+}
+
 void UsbMidiModule::_poll()
 {
-	midi_event_t midiEvent;
-	int numReceived;
+	checkLatency();
 
-	while (numReceived = USB_Recv(getOutEndpointId(), &midiEvent, sizeof(midiEvent)))
+	// Drain the endpoint bank in as few USB_Recv calls as possible. USB MIDI events never span
+	// USB packets, so the trailing bytes of a packet which is not a multiple of 4 long are dropped.
+	uint8_t packet[USB_EP_SIZE];
+	int numAvailable;
+
+	while ((numAvailable = USB_Available(getOutEndpointId())) > 0)
 	{
-		// MIDI USB messages are 4 bytes in size.
-		if (numReceived != 4)
+		if (numAvailable > USB_EP_SIZE)
+			numAvailable = USB_EP_SIZE;
+
+#if USBMIDI_LOSSLESS_RX
+		uint8_t space = m_midiInFifo[0].availableForWrite();
+		for (uint8_t i=1; i<USBMIDI_CABLE_COUNT; ++i)
+		{
+			if (m_midiInFifo[i].availableForWrite() < space)
+				space = m_midiInFifo[i].availableForWrite();
+		}
+
+		// The reads stay a multiple of 4 long, so they don't split events.
+		int room = space * sizeof(midi_event_t);
+		if (room == 0)
 			return;
 
-		// They get decoded to up to 3 MIDI Serial bytes.
-		u8 data[3];
+		if (numAvailable > room)
+			numAvailable = room;
+#endif
 
-		unsigned count = UsbToMidi::process(midiEvent, data);
+		int numReceived = USB_Recv(getOutEndpointId(), packet, numAvailable);
+		if (numReceived <= 0)
+			return;
 
-		if (m_midiInFifo.hasSpaceFor(count))
-		{
-			for (unsigned i=0; i<count; ++i)
-			{
-				m_midiInFifo.push(data[i]);
-			}
-		}
+		Receiver receiver = { *this };
+		UsbToMidi::processPacket(packet, numReceived, receiver);
+	}
+}
+
+void UsbMidiModule::receive(const midi_event_t &ev)
+{
+	// Queued as is into the queue of their cable, they get decoded to MIDI Serial bytes only
+	// when read byte by byte. Events for unknown cables are dropped.
+	uint8_t cable = ev.m_event >> 4;
+	if (cable < USBMIDI_CABLE_COUNT && !m_midiInFifo[cable].push(ev))
+	{
+		++m_overflowCount;
 	}
 }
 
@@ -236,33 +483,81 @@ uint8_t UsbMidiModule::getInterfaceId() const
 USBMIDI_ USBMIDI;
 
 USBMIDI_::USBMIDI_()
+	:USBMIDIPort(0)
 {
 	UsbMidiModule::install();
 }
 
-int USBMIDI_::available()
+int USBMIDIPort::available()
 {
-	return UsbMidiModule::available();
+	return UsbMidiModule::available(m_cable);
 }
 
-int USBMIDI_::read()
+int USBMIDIPort::read()
 {
-	return UsbMidiModule::read();
+	return UsbMidiModule::read(m_cable);
 }
 
-int USBMIDI_::peek()
+int USBMIDIPort::peek()
 {
-	return UsbMidiModule::peek();
+	return UsbMidiModule::peek(m_cable);
 }
 
-void USBMIDI_::flush()
+void USBMIDIPort::flush()
 {
 	UsbMidiModule::flush();
 }
 
-size_t USBMIDI_::write(uint8_t c)
+size_t USBMIDIPort::write(uint8_t c)
+{
+	return UsbMidiModule::write(m_cable, c);
+}
+
+size_t USBMIDIPort::write(const uint8_t *buffer, size_t size)
+{
+	return UsbMidiModule::write(m_cable, buffer, size);
+}
+
+int USBMIDIPort::availableEvents()
+{
+	return UsbMidiModule::availableEvents(m_cable);
+}
+
+bool USBMIDIPort::readEvent(midi_event_t &ev)
+{
+	return UsbMidiModule::readEvent(m_cable, ev);
+}
+
+bool USBMIDIPort::peekEvent(midi_event_t &ev)
+{
+	return UsbMidiModule::peekEvent(m_cable, ev);
+}
+
+bool USBMIDIPort::writeEvent(const midi_event_t &ev)
+{
+	midi_event_t out = ev;
+	out.m_event = (m_cable << 4) | (ev.m_event & 0x0f);
+	return UsbMidiModule::writeEvent(out);
+}
+
+int USBMIDIPort::availableEventsForWrite()
+{
+	return UsbMidiModule::availableEventsForWrite();
+}
+
+void USBMIDIPort::setSysExReceiver(MidiSysExReceiver *receiver)
+{
+	UsbMidiModule::setSysExReceiver(m_cable, receiver);
+}
+
+void USBMIDIPort::setRealTimeCallback(void (*callback)(uint8_t byte))
+{
+	UsbMidiModule::setRealTimeCallback(m_cable, callback);
+}
+
+unsigned int USBMIDI_::getOverflowCount() const
 {
-	return UsbMidiModule::write(c);
+	return UsbMidiModule::getOverflowCount();
 }
 
 void USBMIDI_::poll()
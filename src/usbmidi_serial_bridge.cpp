@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#include "usbmidi_serial_bridge.h"
+
+#if USBMIDI_HAVE_SERIAL_BRIDGE
+
+UsbMidiSerialBridge::UsbMidiSerialBridge(HardwareSerial &serial, USBMIDIPort &port)
+	:m_serial(serial)
+	,m_port(port)
+	,m_midiToUsb(port.getCable())
+	,m_pendingIndex(0)
+	,m_pendingCount(0)
+{
+}
+
+void UsbMidiSerialBridge::begin(unsigned long baud)
+{
+	m_serial.begin(baud);
+	m_midiToUsb.reset();
+	m_runningStatus.reset();
+	m_pendingIndex = m_pendingCount = 0;
+}
+
+void UsbMidiSerialBridge::poll()
+{
+	// Serial to USB, only while the port can take an event without waiting, every byte may
+	// complete one. The rest stays in the serial receive buffer.
+	int n = m_serial.available();
+	int space = m_port.availableEventsForWrite();
+	while (n-- > 0 && space > 0)
+	{
+		midi_event_t ev;
+		if (m_midiToUsb.process(m_serial.read(), ev))
+		{
+			m_port.writeEvent(ev);
+			--space;
+		}
+	}
+
+	// USB to serial, only as much as fits the transmit buffer, the rest stays queued.
+	space = m_serial.availableForWrite();
+	while (space > 0)
+	{
+		if (m_pendingIndex == m_pendingCount)
+		{
+			midi_event_t ev;
+			if (!m_port.readEvent(ev))
+				break;
+
+			m_pendingCount = m_runningStatus.process(ev, m_pending);
+			m_pendingIndex = 0;
+			continue;
+		}
+
+		m_serial.write(m_pending[m_pendingIndex++]);
+		--space;
+	}
+}
+
+UsbToMidiRunningStatus &UsbMidiSerialBridge::getRunningStatus()
+{
+	return m_runningStatus;
+}
+
+#endif // USBMIDI_HAVE_SERIAL_BRIDGE
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015-2018 UAB Vilniaus Blokas
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD license.  See the LICENSE file for details.
+ */
+
+#ifndef USBMIDI_SERIAL_BRIDGE_H
+#define USBMIDI_SERIAL_BRIDGE_H
+
+#include <Arduino.h>
+
+#include "usbmidi.h"
+
+#if defined(HAVE_HWSERIAL0) || defined(HAVE_HWSERIAL1) || defined(HAVE_HWSERIAL2) || defined(HAVE_HWSERIAL3)
+#	define USBMIDI_HAVE_SERIAL_BRIDGE 1
+#else
+#	define USBMIDI_HAVE_SERIAL_BRIDGE 0
+#endif
+
+#if USBMIDI_HAVE_SERIAL_BRIDGE
+
+// Forwards MIDI between a USB cable and a hardware serial port (a DIN MIDI interface) in both
+// directions. The UART interrupts belong to the Arduino core's HardwareSerial, which buffers
+// the received bytes and transmits its output buffer from its own interrupt handlers. The
+// bridge moves data between those buffers and the USB queues, only as much as the receiving
+// side has room for, the rest is left where it is until the next poll(). Incoming serial bytes
+// go through the bridge's own serializer, so the sketch may write to the same cable without
+// corrupting messages, as long as it uses writeEvent or completes each message. Outgoing bytes
+// use running status. Events written to USB are sent once a packet fills up, or at the latest
+// USBMIDI_TX_LATENCY_MS later from USBMIDI.poll() on native USB boards.
+//
+// poll() must be called regularly, like from loop() after USBMIDI.poll(). The serial buffers
+// hold about 20 ms of data at 31250 baud, so the full wire rate is kept as long as loop()
+// comes around more often than that and the host keeps reading. USBMIDI.poll() and flush()
+// may still wait for the host while it's slow to take the output of native USB boards.
+class UsbMidiSerialBridge
+{
+public:
+	explicit UsbMidiSerialBridge(HardwareSerial &serial, USBMIDIPort &port = USBMIDI);
+
+	// Opens the serial port at the MIDI baud rate.
+	void begin(unsigned long baud = 31250);
+
+	// Forwards what's available in both directions, as far as the other side has room for it.
+	void poll();
+
+	UsbToMidiRunningStatus &getRunningStatus();
+
+private:
+	HardwareSerial &m_serial;
+	USBMIDIPort &m_port;
+
+	MidiToUsb m_midiToUsb;
+	UsbToMidiRunningStatus m_runningStatus;
+
+	// Bytes of a message from USB which didn't fit the serial output buffer yet.
+	uint8_t m_pending[3];
+	uint8_t m_pendingIndex;
+	uint8_t m_pendingCount;
+};
+
+#endif // USBMIDI_HAVE_SERIAL_BRIDGE
+
+#endif // USBMIDI_SERIAL_BRIDGE_H
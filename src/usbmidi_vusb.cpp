@@ -20,6 +20,8 @@
 #include "usbdrv.h"
 
 #include "fifo.h"
+#include "midi_coalesce.h"
+#include "midi_in_fifo.h"
 #include "midi_serialization.h"
 #include "usbmidi.h"
 
@@ -33,6 +35,24 @@
 static void (*g_suspendResumeCallback)(bool suspended) = NULL;
 #endif
 
+// Queue capacities, counted in USB MIDI events (4 bytes each). Each cable has its own input
+// queue, the output queue is shared by all cables of an IN endpoint.
+#ifndef USBMIDI_VUSB_IN_EVENTS
+#define USBMIDI_VUSB_IN_EVENTS 15
+#endif
+
+#ifndef USBMIDI_VUSB_OUT_EVENTS
+#define USBMIDI_VUSB_OUT_EVENTS 15
+#endif
+
+#if USBMIDI_VUSB_IN_EVENTS < 2 || USBMIDI_VUSB_IN_EVENTS > 254
+#	error USBMIDI_VUSB_IN_EVENTS must be between 2 and 254!
+#endif
+
+#if USBMIDI_VUSB_OUT_EVENTS < 2 || USBMIDI_VUSB_OUT_EVENTS > 254
+#	error USBMIDI_VUSB_OUT_EVENTS must be between 2 and 254!
+#endif
+
 // USB device descriptor
 static const PROGMEM unsigned char deviceDescrMIDI[] =
 {
@@ -52,13 +72,107 @@ static const PROGMEM unsigned char deviceDescrMIDI[] =
 	1,                      // number of configurations
 };
 
+#if USBMIDI_CABLE_COUNT > 5 && !USB_CFG_LONG_TRANSFERS
+#	error More than 5 cables make the configuration descriptor exceed 255 bytes, USB_CFG_LONG_TRANSFERS must be enabled.
+#endif
+
+#define USBMIDI_CABLES_1(M) M(0)
+#define USBMIDI_CABLES_2(M) USBMIDI_CABLES_1(M) M(1)
+#define USBMIDI_CABLES_3(M) USBMIDI_CABLES_2(M) M(2)
+#define USBMIDI_CABLES_4(M) USBMIDI_CABLES_3(M) M(3)
+#define USBMIDI_CABLES_5(M) USBMIDI_CABLES_4(M) M(4)
+#define USBMIDI_CABLES_6(M) USBMIDI_CABLES_5(M) M(5)
+#define USBMIDI_CABLES_7(M) USBMIDI_CABLES_6(M) M(6)
+#define USBMIDI_CABLES_8(M) USBMIDI_CABLES_7(M) M(7)
+#define USBMIDI_CABLES_9(M) USBMIDI_CABLES_8(M) M(8)
+#define USBMIDI_CABLES_10(M) USBMIDI_CABLES_9(M) M(9)
+#define USBMIDI_CABLES_11(M) USBMIDI_CABLES_10(M) M(10)
+#define USBMIDI_CABLES_12(M) USBMIDI_CABLES_11(M) M(11)
+#define USBMIDI_CABLES_13(M) USBMIDI_CABLES_12(M) M(12)
+#define USBMIDI_CABLES_14(M) USBMIDI_CABLES_13(M) M(13)
+#define USBMIDI_CABLES_15(M) USBMIDI_CABLES_14(M) M(14)
+#define USBMIDI_CABLES_16(M) USBMIDI_CABLES_15(M) M(15)
+#define USBMIDI_CABLES_(count, M) USBMIDI_CABLES_ ## count(M)
+#define USBMIDI_CABLES(count, M) USBMIDI_CABLES_(count, M)
+
+// Expands M(cable) for every cable.
+#define USBMIDI_FOR_EACH_CABLE(M) USBMIDI_CABLES(USBMIDI_CABLE_COUNT, M)
+
+// Each cable has 4 jacks, numbered from 1.
+#define USBMIDI_JACK_ID(cable, n) (4 * (cable) + (n))
+
+// B.4.3 MIDI IN Jack Descriptors and B.4.4 MIDI OUT Jack Descriptors of a single cable.
+#define USBMIDI_CABLE_JACKS(cable) \
+	6, 36, 2, 1, USBMIDI_JACK_ID(cable, 1), 0,                              /* MIDI_IN_JACK, EMBEDDED */ \
+	6, 36, 2, 2, USBMIDI_JACK_ID(cable, 2), 0,                              /* MIDI_IN_JACK, EXTERNAL */ \
+	9, 36, 3, 1, USBMIDI_JACK_ID(cable, 3), 1, USBMIDI_JACK_ID(cable, 2), 1, 0, /* MIDI_OUT_JACK, EMBEDDED */ \
+	9, 36, 3, 2, USBMIDI_JACK_ID(cable, 4), 1, USBMIDI_JACK_ID(cable, 1), 1, 0, /* MIDI_OUT_JACK, EXTERNAL */
+
+#define USBMIDI_EMBEDDED_IN_JACK_ID(cable) USBMIDI_JACK_ID(cable, 1),
+#define USBMIDI_EMBEDDED_OUT_JACK_ID(cable) USBMIDI_JACK_ID(cable, 3),
+
+#if USBMIDI_VUSB_DUAL_IN
+#	if USBMIDI_CABLE_COUNT < 2
+#		error USBMIDI_VUSB_DUAL_IN requires USBMIDI_CABLE_COUNT of at least 2!
+#	endif
+
+// Even cables are sent through endpoint 1, odd ones through endpoint 3. The cable number
+// of an event is the index of the jack within the list of the endpoint it's sent through,
+// so each endpoint keeps the order of its own cables.
+#	define USBMIDI_HALF_2  1
+#	define USBMIDI_HALF_3  1
+#	define USBMIDI_HALF_4  2
+#	define USBMIDI_HALF_5  2
+#	define USBMIDI_HALF_6  3
+#	define USBMIDI_HALF_7  3
+#	define USBMIDI_HALF_8  4
+#	define USBMIDI_HALF_9  4
+#	define USBMIDI_HALF_10 5
+#	define USBMIDI_HALF_11 5
+#	define USBMIDI_HALF_12 6
+#	define USBMIDI_HALF_13 6
+#	define USBMIDI_HALF_14 7
+#	define USBMIDI_HALF_15 7
+#	define USBMIDI_HALF_16 8
+#	define USBMIDI_HALF_(count) USBMIDI_HALF_ ## count
+#	define USBMIDI_HALF(count) USBMIDI_HALF_(count)
+
+#	define USBMIDI_EP3_CABLE_COUNT USBMIDI_HALF(USBMIDI_CABLE_COUNT)
+#	define USBMIDI_EP1_CABLE_COUNT (USBMIDI_CABLE_COUNT - USBMIDI_EP3_CABLE_COUNT)
+
+#	define USBMIDI_EVEN_OUT_JACK_ID(i) USBMIDI_JACK_ID(2 * (i), 3),
+#	define USBMIDI_ODD_OUT_JACK_ID(i) USBMIDI_JACK_ID(2 * (i) + 1, 3),
+
+#	define USBMIDI_EP1_JACK_IDS USBMIDI_CABLES(USBMIDI_HALF(USBMIDI_CABLE_COUNT), USBMIDI_EVEN_OUT_JACK_ID) \
+		USBMIDI_EP1_EXTRA_JACK_ID
+#	if USBMIDI_CABLE_COUNT % 2
+#		define USBMIDI_EP1_EXTRA_JACK_ID USBMIDI_EVEN_OUT_JACK_ID(USBMIDI_HALF(USBMIDI_CABLE_COUNT))
+#	else
+#		define USBMIDI_EP1_EXTRA_JACK_ID
+#	endif
+#	define USBMIDI_EP3_JACK_IDS USBMIDI_CABLES(USBMIDI_HALF(USBMIDI_CABLE_COUNT), USBMIDI_ODD_OUT_JACK_ID)
+
+#	define USBMIDI_MS_ENDPOINT_COUNT 3
+#else
+#	define USBMIDI_EP1_CABLE_COUNT USBMIDI_CABLE_COUNT
+#	define USBMIDI_EP1_JACK_IDS USBMIDI_FOR_EACH_CABLE(USBMIDI_EMBEDDED_OUT_JACK_ID)
+
+#	define USBMIDI_MS_ENDPOINT_COUNT 2
+#endif
+
+// Class-specific MS header, jacks and the endpoints with their class-specific descriptors,
+// the jacks of every cable are associated with exactly one of the IN endpoints.
+#define USBMIDI_MS_TOTAL_LENGTH (7 + 30 * USBMIDI_CABLE_COUNT + USBMIDI_MS_ENDPOINT_COUNT * (9 + 4) + 2 * USBMIDI_CABLE_COUNT)
+#define USBMIDI_CONFIG_TOTAL_LENGTH (9 + 9 + 9 + 9 + USBMIDI_MS_TOTAL_LENGTH)
+
 // B.2 Configuration Descriptor
 // USB configuration descriptor
 static const PROGMEM unsigned char configDescrMIDI[] =
 {
 	9,                      // sizeof(usbDescrConfig): length of descriptor in bytes
 	USBDESCR_CONFIG,        // descriptor type
-	101, 0,                 // total length of data returned (including inlined descriptors)
+	USBMIDI_CONFIG_TOTAL_LENGTH & 0xff,
+	USBMIDI_CONFIG_TOTAL_LENGTH >> 8, // total length of data returned (including inlined descriptors)
 	2,                      // number of interfaces in this configuration
 	1,                      // index of this configuration
 	0,                      // configuration name string index
@@ -115,7 +229,7 @@ static const PROGMEM unsigned char configDescrMIDI[] =
 	USBDESCR_INTERFACE,     // descriptor type
 	1,                      // index of this interface
 	0,                      // alternate setting for this interface
-	2,                      // endpoints excl 0: number of endpoint descriptors to follow
+	USBMIDI_MS_ENDPOINT_COUNT, // endpoints excl 0: number of endpoint descriptors to follow
 	1,                      // AUDIO
 	3,                      // MS
 	0,                      // unused
@@ -127,43 +241,11 @@ static const PROGMEM unsigned char configDescrMIDI[] =
 	36,                     // descriptor type
 	1,                      // header functional descriptor
 	0x0, 0x01,              // bcdADC
-	65, 0,                  // wTotalLength
+	USBMIDI_MS_TOTAL_LENGTH & 0xff,
+	USBMIDI_MS_TOTAL_LENGTH >> 8, // wTotalLength
 
-	// B.4.3 MIDI IN Jack Descriptor
-	6,                      // bLength
-	36,                     // descriptor type
-	2,                      // MIDI_IN_JACK desc subtype
-	1,                      // EMBEDDED bJackType
-	1,                      // bJackID
-	0,                      // iJack
-
-	6,                      // bLength
-	36,                     // descriptor type
-	2,                      // MIDI_IN_JACK desc subtype
-	2,                      // EXTERNAL bJackType
-	2,                      // bJackID
-	0,                      // iJack
-
-	//B.4.4 MIDI OUT Jack Descriptor
-	9,                      // length of descriptor in bytes
-	36,                     // descriptor type
-	3,                      // MIDI_OUT_JACK descriptor
-	1,                      // EMBEDDED bJackType
-	3,                      // bJackID
-	1,                      // No of input pins
-	2,                      // BaSourceID
-	1,                      // BaSourcePin
-	0,                      // iJack
-
-	9,                      // bLength of descriptor in bytes
-	36,                     // bDescriptorType
-	3,                      // MIDI_OUT_JACK bDescriptorSubtype
-	2,                      // EXTERNAL bJackType
-	4,                      // bJackID
-	1,                      // bNrInputPins
-	1,                      // baSourceID (0)
-	1,                      // baSourcePin (0)
-	0,                      // iJack
+	// B.4.3 MIDI IN Jack Descriptors and B.4.4 MIDI OUT Jack Descriptors
+	USBMIDI_FOR_EACH_CABLE(USBMIDI_CABLE_JACKS)
 
 	// B.5 Bulk OUT Endpoint Descriptors
 	//B.5.1 Standard Bulk OUT Endpoint Descriptor
@@ -172,16 +254,16 @@ static const PROGMEM unsigned char configDescrMIDI[] =
 	0x1,                    // bEndpointAddress OUT endpoint number 1
 	3,                      // bmAttributes: 2:Bulk, 3:Interrupt endpoint
 	8, 0,                   // wMaxPacketSize
-	10,                     // bInterval in ms
+	USB_CFG_INTR_POLL_INTERVAL, // bInterval in ms
 	0,                      // bRefresh
 	0,                      // bSyncAddress
 
 	// B.5.2 Class-specific MS Bulk OUT Endpoint Descriptor
-	5,                      // bLength of descriptor in bytes
+	4 + USBMIDI_CABLE_COUNT, // bLength of descriptor in bytes
 	37,                     // bDescriptorType
 	1,                      // bDescriptorSubtype
-	1,                      // bNumEmbMIDIJack 
-	1,                      // baAssocJackID (0)
+	USBMIDI_CABLE_COUNT,    // bNumEmbMIDIJack
+	USBMIDI_FOR_EACH_CABLE(USBMIDI_EMBEDDED_IN_JACK_ID) // baAssocJackID
 
 	//B.6 Bulk IN Endpoint Descriptors
 	//B.6.1 Standard Bulk IN Endpoint Descriptor
@@ -190,21 +272,58 @@ static const PROGMEM unsigned char configDescrMIDI[] =
 	0x81,                   // bEndpointAddress IN endpoint number 1
 	3,                      // bmAttributes: 2: Bulk, 3: Interrupt endpoint
 	8, 0,                   // wMaxPacketSize
-	10,                     // bIntervall in ms
+	USB_CFG_INTR_POLL_INTERVAL, // bInterval in ms
 	0,                      // bRefresh
 	0,                      // bSyncAddress
 
 	// B.6.2 Class-specific MS Bulk IN Endpoint Descriptor
-	5,                      // bLength of descriptor in bytes
+	4 + USBMIDI_EP1_CABLE_COUNT, // bLength of descriptor in bytes
 	37,                     // bDescriptorType
 	1,                      // bDescriptorSubtype
-	1,                      // bNumEmbMIDIJack (0)
-	3,                      // baAssocJackID (0)
+	USBMIDI_EP1_CABLE_COUNT, // bNumEmbMIDIJack
+	USBMIDI_EP1_JACK_IDS    // baAssocJackID
+
+#if USBMIDI_VUSB_DUAL_IN
+	// Second IN Endpoint Descriptors, carrying the odd cables.
+	9,                      // bLength
+	USBDESCR_ENDPOINT,      // bDescriptorType = endpoint
+	0x80 | USB_CFG_EP3_NUMBER, // bEndpointAddress IN endpoint number 3
+	3,                      // bmAttributes: 2: Bulk, 3: Interrupt endpoint
+	8, 0,                   // wMaxPacketSize
+	USB_CFG_INTR_POLL_INTERVAL, // bInterval in ms
+	0,                      // bRefresh
+	0,                      // bSyncAddress
+
+	4 + USBMIDI_EP3_CABLE_COUNT, // bLength of descriptor in bytes
+	37,                     // bDescriptorType
+	1,                      // bDescriptorSubtype
+	USBMIDI_EP3_CABLE_COUNT, // bNumEmbMIDIJack
+	USBMIDI_EP3_JACK_IDS    // baAssocJackID
+#endif
+};
+
+// TFifo keeps one slot free to tell a full queue from an empty one.
+static TMidiInFifo<USBMIDI_VUSB_IN_EVENTS + 1> g_midiInput[USBMIDI_CABLE_COUNT];
+typedef TFifo<midi_event_t, uint8_t, USBMIDI_VUSB_OUT_EVENTS + 1> EventFifo;
+typedef TFifo<midi_event_t, uint8_t, 4> RealTimeFifo;
+
+// Output of an interrupt IN endpoint. Real-Time messages have a lane of their own, which gets
+// drained first, so they don't wait behind other queued messages.
+struct output_queue_t
+{
+	EventFifo m_events;
+	RealTimeFifo m_realTime;
+
+	inline bool empty() const { return m_events.empty() && m_realTime.empty(); }
+	inline uint8_t availableForWrite() const { return m_realTime.full() ? 0 : USBMIDI_VUSB_OUT_EVENTS - m_events.size(); }
 };
 
-static TFifo<uint8_t, uint8_t, 64> g_midiInput;
-static TFifo<uint8_t, uint8_t, 64> g_midiOutput;
-static MidiToUsb g_serializer(0);
+static output_queue_t g_midiOutput;
+#if USBMIDI_VUSB_DUAL_IN
+static output_queue_t g_midiOutput3;
+#endif
+static MidiToUsb g_serializer[USBMIDI_CABLE_COUNT];
+static unsigned int g_overflowCount;
 
 __attribute__((weak)) USBMIDI_DEFINE_VENDOR_NAME(USB_CFG_VENDOR_NAME);
 __attribute__((weak)) USBMIDI_DEFINE_PRODUCT_NAME(USB_CFG_DEVICE_NAME);
@@ -247,27 +366,67 @@ uint8_t usbFunctionSetup(uint8_t data[8])
 	return 0;
 }
 
-// Called when receiving MIDI message from PC.
-void usbFunctionWriteOut(uint8_t * data, uint8_t len)
+#if USB_CFG_HAVE_FLOWCONTROL
+// Bit mask of the cables the sketch has read from. Only these throttle the host, input for the
+// rest gets dropped once their queues are full, so sketches which never read don't stall the device.
+static uint16_t g_readCables;
+
+// An OUT packet carries up to 2 events, which must fit into the queue of any cable being read.
+static bool hasInputSpace()
 {
-	uint8_t m[3];
-	for (uint8_t i=0; i<len; i+=4)
+	for (uint8_t i=0; i<USBMIDI_CABLE_COUNT; ++i)
 	{
-		midi_event_t event;
-		event.m_event   = data[i+0];
-		event.m_data[0] = data[i+1];
-		event.m_data[1] = data[i+2];
-		event.m_data[2] = data[i+3];
-		uint8_t n = UsbToMidi::process(event, m);
-		for (uint8_t j=0; j<n; ++j)
+		if ((g_readCables & (1u << i)) && g_midiInput[i].availableForWrite() < 2)
+			return false;
+	}
+	return true;
+}
+#endif
+
+// Called after reading input, to start accepting OUT packets again once there's space for them.
+static void resumeInput(uint8_t cable)
+{
+#if USB_CFG_HAVE_FLOWCONTROL
+	g_readCables |= 1u << cable;
+	if (usbAllRequestsAreDisabled() && hasInputSpace())
+		usbEnableAllRequests();
+#endif
+}
+
+// Queues the events of received packets into the input queue of their cable.
+struct input_receiver_t
+{
+	inline void operator()(const midi_event_t &ev)
+	{
+		// Events for unknown cables are dropped.
+		uint8_t cable = ev.m_event >> 4;
+		if (cable < USBMIDI_CABLE_COUNT && !g_midiInput[cable].push(ev))
 		{
-			g_midiInput.push(m[j]);
+			++g_overflowCount;
 		}
 	}
+};
+
+// Called when receiving MIDI message from PC.
+void usbFunctionWriteOut(uint8_t * data, uint8_t len)
+{
+	input_receiver_t receiver;
+	UsbToMidi::processPacket(data, len, receiver);
+
+#if USB_CFG_HAVE_FLOWCONTROL
+	// NAK further packets until the sketch reads enough input.
+	if (!hasInputSpace())
+		usbDisableAllRequests();
+#endif
 }
 
 static void midiUsbInit(void)
 {
+	for (uint8_t i=0; i<USBMIDI_CABLE_COUNT; ++i)
+	{
+		g_serializer[i].setCable(i);
+	}
+
 	// Activate pull-ups except on USB lines.
 	USB_CFG_IOPORT = (uint8_t)~((1 << USB_CFG_DMINUS_BIT) | (1 << USB_CFG_DPLUS_BIT));
 
@@ -298,71 +457,163 @@ static void midiUsbInit(void)
 USBMIDI_ USBMIDI;
 
 USBMIDI_::USBMIDI_()
+	:USBMIDIPort(0)
 {
 	midiUsbInit();
 }
 
-int USBMIDI_::available()
+int USBMIDIPort::available()
 {
-	return g_midiInput.size();
+	return g_midiInput[m_cable].available();
 }
 
-int USBMIDI_::read()
+int USBMIDIPort::read()
 {
-	uint8_t byte;
-	if (g_midiInput.pop(byte))
-	{
-		return byte;
-	}
-	else return -1;
+	int byte = g_midiInput[m_cable].read();
+	resumeInput(m_cable);
+	return byte;
 }
 
-int USBMIDI_::peek()
+int USBMIDIPort::peek()
 {
-	uint8_t byte;
-	if (g_midiInput.peek(byte))
+	return g_midiInput[m_cable].peek();
+}
+
+static bool outputEmpty()
+{
+#if USBMIDI_VUSB_DUAL_IN
+	return g_midiOutput.empty() && g_midiOutput3.empty();
+#else
+	return g_midiOutput.empty();
+#endif
+}
+
+void USBMIDIPort::flush()
+{
+	while (!outputEmpty())
 	{
-		return byte;
+		USBMIDI.poll();
 	}
-	else return -1;
 }
 
-void USBMIDI_::flush()
+static void queueEvent(const midi_event_t &ev)
 {
-	while (!g_midiOutput.empty())
+#if USBMIDI_VUSB_DUAL_IN
+	// Renumber the cable to its index within the jacks of the endpoint.
+	uint8_t cable = ev.m_event >> 4;
+	output_queue_t &queue = (cable & 1) ? g_midiOutput3 : g_midiOutput;
+
+	midi_event_t out = ev;
+	out.m_event = ((cable >> 1) << 4) | (ev.m_event & 0x0f);
+#else
+	output_queue_t &queue = g_midiOutput;
+	const midi_event_t &out = ev;
+#endif
+
+	if ((out.m_event & 0x0f) == 0x0f && midi_is_real_time(out.m_data[0]))
 	{
-		poll();
+		while (queue.m_realTime.full())
+			USBMIDI.poll();
+
+		queue.m_realTime.push(out);
+		return;
 	}
+
+#if USBMIDI_COALESCE
+	if (midi_coalesce(queue.m_events, queue.m_events.size(), out))
+		return;
+#endif
+
+	while (queue.m_events.full())
+		USBMIDI.poll();
+
+	queue.m_events.push(out);
 }
 
-size_t USBMIDI_::write(uint8_t c)
+size_t USBMIDIPort::write(uint8_t c)
 {
-	if (g_midiOutput.full())
-		flush();
+	midi_event_t ev;
+	if (g_serializer[m_cable].process(c, ev))
+		queueEvent(ev);
 
-	g_midiOutput.push(c);
 	return sizeof(c);
 }
 
-static uint8_t fillBuffer(uint8_t buffer[8])
+size_t USBMIDIPort::write(const uint8_t *buffer, size_t size)
 {
-	midi_event_t ev;
-	uint8_t byte;
-	uint8_t n=0;
-	for (uint8_t i=0; !g_midiOutput.empty() && i<2; ++i)
+	midi_event_t events[2];
+	size_t remaining = size;
+	while (remaining)
 	{
-		while (g_midiOutput.pop(byte))
+		size_t consumed;
+		size_t count = g_serializer[m_cable].processBuffer(buffer, remaining, events, 2, consumed);
+		for (size_t i=0; i<count; ++i)
 		{
-			if (g_serializer.process(byte, ev))
-			{
-				memcpy(&buffer[i * sizeof(ev)], &ev, sizeof(ev));
-				++n;
-				break;
-			}
+			queueEvent(events[i]);
 		}
+		buffer += consumed;
+		remaining -= consumed;
 	}
+	return size;
+}
 
-	return n * sizeof(ev);
+int USBMIDIPort::availableEvents()
+{
+	return g_midiInput[m_cable].availableEvents();
+}
+
+bool USBMIDIPort::readEvent(midi_event_t &ev)
+{
+	bool result = g_midiInput[m_cable].readEvent(ev);
+	resumeInput(m_cable);
+	return result;
+}
+
+bool USBMIDIPort::peekEvent(midi_event_t &ev)
+{
+	return g_midiInput[m_cable].peekEvent(ev);
+}
+
+bool USBMIDIPort::writeEvent(const midi_event_t &ev)
+{
+	midi_event_t out = ev;
+	out.m_event = (m_cable << 4) | (ev.m_event & 0x0f);
+	queueEvent(out);
+	return true;
+}
+
+int USBMIDIPort::availableEventsForWrite()
+{
+#if USBMIDI_VUSB_DUAL_IN
+	const output_queue_t &queue = (m_cable & 1) ? g_midiOutput3 : g_midiOutput;
+#else
+	const output_queue_t &queue = g_midiOutput;
+#endif
+	return queue.availableForWrite();
+}
+
+void USBMIDIPort::setSysExReceiver(MidiSysExReceiver *receiver)
+{
+	g_midiInput[m_cable].setSysExReceiver(receiver);
+}
+
+void USBMIDIPort::setRealTimeCallback(void (*callback)(uint8_t byte))
+{
+	g_midiInput[m_cable].setRealTimeCallback(callback);
+}
+
+// Events are queued already serialized, so only copying them is left to do once the endpoint is ready.
+static uint8_t fillBuffer(output_queue_t &queue, uint8_t buffer[8])
+{
+	midi_event_t *events = reinterpret_cast<midi_event_t *>(buffer);
+	uint8_t n = queue.m_realTime.pop(events, 2);
+	n += queue.m_events.pop(events + n, 2 - n);
+	return n * sizeof(midi_event_t);
+}
+
+unsigned int USBMIDI_::getOverflowCount() const
+{
+	return g_overflowCount;
 }
 
 void USBMIDI_::setSuspendResumeCallback(void (*callback)(bool suspended))
@@ -413,11 +664,21 @@ void USBMIDI_::poll()
 	if (!g_midiOutput.empty() && usbInterruptIsReady())
 	{
 		uint8_t buffer[8];
-		uint8_t n = fillBuffer(buffer);
+		uint8_t n = fillBuffer(g_midiOutput, buffer);
 
 		if (n)
 			usbSetInterrupt(buffer, n);
 	}
+#if USBMIDI_VUSB_DUAL_IN
+	if (!g_midiOutput3.empty() && usbInterruptIsReady3())
+	{
+		uint8_t buffer[8];
+		uint8_t n = fillBuffer(g_midiOutput3, buffer);
+
+		if (n)
+			usbSetInterrupt3(buffer, n);
+	}
+#endif
 	usbPoll();
 }
 